@@ -0,0 +1,190 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+#include <memory>
+#include <vector>
+
+namespace GIFT {
+
+// Strategy used by FeatureTracker to find new corners in the grey image.
+// Detectors keep scratch buffers between calls, so do not share one between threads. Clone it instead.
+class CornerDetector {
+public:
+    virtual ~CornerDetector() = default;
+    // Finds at most maxCorners corners, at least minDistance apart and inside the mask if it is not empty.
+    virtual void detect(const cv::Mat& imageGrey, const cv::Mat& mask, int maxCorners, double minDistance,
+                        std::vector<cv::Point2f>& corners) = 0;
+    // Returns a detector with the same settings and buffers of its own.
+    virtual std::shared_ptr<CornerDetector> clone() const = 0;
+};
+
+// The detector of a FeatureTracker. Copying it clones the detector, so copied trackers can run on other threads.
+class CornerDetectorPtr {
+public:
+    CornerDetectorPtr() = default;
+    CornerDetectorPtr(std::nullptr_t) {};
+    template<typename Detector>
+    CornerDetectorPtr(std::shared_ptr<Detector> detector) : detector(std::move(detector)) {};
+    CornerDetectorPtr(const CornerDetectorPtr& other) : detector(other.detector ? other.detector->clone() : nullptr) {};
+    CornerDetectorPtr(CornerDetectorPtr&& other) = default;
+    CornerDetectorPtr& operator=(const CornerDetectorPtr& other) {
+        if (this != &other) detector = other.detector ? other.detector->clone() : nullptr;
+        return *this;
+    };
+    CornerDetectorPtr& operator=(CornerDetectorPtr&& other) = default;
+
+    CornerDetector* operator->() const { return detector.get(); };
+    CornerDetector& operator*() const { return *detector; };
+    explicit operator bool() const { return (bool)detector; };
+    const std::shared_ptr<CornerDetector>& get() const { return detector; };
+
+protected:
+    std::shared_ptr<CornerDetector> detector;
+};
+
+// Accepts points greedily, rejecting any closer than minDistance to a point already accepted.
+class CornerSpacingGrid {
+public:
+    void reset(const cv::Size& imageSize, double minDistance);
+    bool tryInsert(const cv::Point2f& point);
+
+protected:
+    double minDistanceSq = 0;
+    float cellSize = 1;
+    int cols = 0;
+    int rows = 0;
+    std::vector<int> cellHeads;
+    std::vector<int> nextInCell;
+    std::vector<cv::Point2f> points;
+};
+
+// Shi-Tomasi corners from goodFeaturesToTrack.
+class ShiTomasiDetector : public CornerDetector {
+public:
+    double qualityLevel = 0.1;
+    int blockSize = 3;
+
+    void detect(const cv::Mat& imageGrey, const cv::Mat& mask, int maxCorners, double minDistance,
+                std::vector<cv::Point2f>& corners) override;
+    std::shared_ptr<CornerDetector> clone() const override;
+};
+
+// Shi-Tomasi corners from a minimum eigenvalue map that is kept between frames in square tiles.
+// A tile is recomputed only when the image inside it, or in a neighbouring tile that its filters reach into,
+// has changed by more than changeThreshold (mean absolute grey level of the changed tile, against the image
+// last seen there), so detection in a slowly changing scene costs little more than the comparison.
+// The cache is indexed by position in the image that imageGrey is a region of, so the bands and regions
+// searched by FeatureTracker share it. Corners are selected as goodFeaturesToTrack selects them.
+class CornerResponseCache : public CornerDetector {
+public:
+    CornerResponseCache(int tileSize = 32, double changeThreshold = 2.0);
+    double qualityLevel = 0.1;
+    int blockSize = 3;
+    int tileSize;
+    double changeThreshold;
+
+    void detect(const cv::Mat& imageGrey, const cv::Mat& mask, int maxCorners, double minDistance,
+                std::vector<cv::Point2f>& corners) override;
+    // The clone starts with an empty cache.
+    std::shared_ptr<CornerDetector> clone() const override;
+    // Forgets every tile, so the next detection recomputes the whole map.
+    void clear();
+    // Tiles recomputed and reused by the last detection.
+    int recomputedTiles() const { return lastRecomputed; };
+    int reusedTiles() const { return lastReused; };
+
+protected:
+    void refreshTiles(const cv::Mat& wholeGrey, const cv::Rect& region);
+
+    cv::Size cachedSize;
+    int tileCols = 0;
+    int tileRows = 0;
+    std::vector<uchar> tileValid;       // The response of the tile is up to date
+    std::vector<uchar> referenceValid;  // The reference holds the tile's pixels that the responses were computed from
+    cv::Mat response;   // CV_32FC1, the size of the whole image
+    cv::Mat reference;  // The grey image last seen in each tile
+    cv::Mat tileResponse;
+    std::vector<std::pair<float, cv::Point>> candidates;
+    CornerSpacingGrid spacing;
+    int lastRecomputed = 0;
+    int lastReused = 0;
+};
+
+// Base for detectors that produce scored keypoints. Keypoints are taken in order of their response.
+class KeyPointCornerDetector : public CornerDetector {
+public:
+    void detect(const cv::Mat& imageGrey, const cv::Mat& mask, int maxCorners, double minDistance,
+                std::vector<cv::Point2f>& corners) override;
+
+protected:
+    virtual void detectKeyPoints(const cv::Mat& imageGrey, std::vector<cv::KeyPoint>& keyPoints) = 0;
+
+    std::vector<cv::KeyPoint> keyPoints;
+    CornerSpacingGrid spacing;
+};
+
+// FAST 9/16 corners with optional non-maximum suppression.
+class FASTDetector : public KeyPointCornerDetector {
+public:
+    FASTDetector(int threshold = 20, bool nonmaxSuppression = true);
+    int threshold;
+    bool nonmaxSuppression;
+    std::shared_ptr<CornerDetector> clone() const override;
+
+protected:
+    void detectKeyPoints(const cv::Mat& imageGrey, std::vector<cv::KeyPoint>& keyPoints) override;
+    cv::Ptr<cv::FastFeatureDetector> detector;
+};
+
+// AGAST (OAST 9/16) corners with optional non-maximum suppression.
+class AGASTDetector : public KeyPointCornerDetector {
+public:
+    AGASTDetector(int threshold = 10, bool nonmaxSuppression = true);
+    int threshold;
+    bool nonmaxSuppression;
+    std::shared_ptr<CornerDetector> clone() const override;
+
+protected:
+    void detectKeyPoints(const cv::Mat& imageGrey, std::vector<cv::KeyPoint>& keyPoints) override;
+    cv::Ptr<cv::AgastFeatureDetector> detector;
+};
+
+// Runs another detector on each cell of a grid with an equal share of the corners, as ORB does,
+// so that weakly textured regions still get corners. Corners within a few pixels of the cell
+// edges may be missed by detectors that skip the image border.
+class GridDetector : public CornerDetector {
+public:
+    GridDetector(std::shared_ptr<CornerDetector> cellDetector, int gridRows = 4, int gridCols = 4);
+    std::shared_ptr<CornerDetector> cellDetector;
+    int gridRows;
+    int gridCols;
+
+    void detect(const cv::Mat& imageGrey, const cv::Mat& mask, int maxCorners, double minDistance,
+                std::vector<cv::Point2f>& corners) override;
+    // Also clones the cell detector.
+    std::shared_ptr<CornerDetector> clone() const override;
+
+protected:
+    std::vector<cv::Point2f> cellCorners;
+    CornerSpacingGrid spacing;
+};
+
+}
@@ -0,0 +1,76 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CameraParameters.h"
+#include "eigen3/Eigen/Dense"
+#include "opencv2/core/core.hpp"
+#include "opencv2/video/tracking.hpp"
+#include <utility>
+#include <vector>
+
+namespace GIFT {
+
+enum class DenseFlowQuality {UltraFast, Fast, Medium};
+
+// An alternative to FeatureTracker as a source of flow for EgoMotion. Dense optical flow is computed
+// between consecutive images and sampled on a regular grid, giving many more (but individually less
+// accurate) flows than corner tracking, including in scenes with little texture.
+// Uses DIS optical flow with OpenCV 4, and Farneback flow with older versions.
+class DenseFlowSampler {
+public:
+    int gridSpacing = 16;   // Pixels between samples
+    DenseFlowQuality quality = DenseFlowQuality::UltraFast;
+    double maxFlow = 100;   // Samples moving further than this (in pixels) are discarded
+
+    DenseFlowSampler(const CameraParameters &configuration = CameraParameters()) { camera = configuration; };
+    void setCameraConfiguration(const CameraParameters &configuration);
+    void setMask(const cv::Mat& mask);
+
+    // Computes the flow from the previous image. Returns false for the first image, which has no flow.
+    bool processImage(const cv::Mat& image);
+
+    // Bearing and flow on the unit sphere for each sample, in the format EgoMotion takes.
+    const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& sphereFlows() const { return flows; };
+    const cv::Mat& flowField() const { return flow; };
+
+protected:
+    void updateGrid(const cv::Size& imageSize);
+
+    CameraParameters camera;
+    cv::Mat imageMask;
+
+    cv::Ptr<cv::DenseOpticalFlow> flowMethod;
+    DenseFlowQuality flowMethodQuality;
+    cv::Mat previousGrey;
+    cv::Mat currentGrey;
+    cv::Mat flow;
+
+    // Sample positions in the previous image, updated when the image size or spacing changes
+    cv::Size gridImageSize;
+    int gridImageSpacing = 0;
+    std::vector<cv::Point2f> gridPoints;
+    std::vector<cv::Point2f> gridPointsNorm;
+
+    std::vector<cv::Point2f> movedPoints;
+    std::vector<int> movedSamples;
+    std::vector<cv::Point2f> movedPointsNorm;
+    std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> flows;
+};
+
+}
@@ -19,6 +19,7 @@
 
 #include "Landmark.h"
 #include "eigen3/Eigen/Dense"
+#include <atomic>
 
 using namespace Eigen;
 using namespace cv;
@@ -26,6 +27,44 @@ using namespace std;
 
 namespace GIFT {
 
+// An angular velocity measured by a gyroscope, in the camera frame and the time units of the flow.
+// The bias is subtracted from the measurement. If estimateBias is set, the bias is refined from the
+// flow, and biasRegularisation (relative to the mean squared flow residual) keeps it near the given value.
+struct GyroMeasurement {
+    Vector3d angularVelocity;
+    Vector3d bias = Vector3d::Zero();
+    bool estimateBias = false;
+    double biasRegularisation = 0.1;
+
+    GyroMeasurement(const Vector3d& angularVelocity, const Vector3d& bias = Vector3d::Zero(), bool estimateBias = false)
+        : angularVelocity(angularVelocity), bias(bias), estimateBias(estimateBias) {};
+};
+
+// Options for solving from several initialisations. The starts are translation directions spread over a
+// hemisphere (the residual does not depend on their sign), each with the angular velocity that fits it best.
+// The starts share the best residual found so far, and those that stay far above it are abandoned early.
+// By default the starts are solved in turn on the calling thread. Each solve with more threads starts and joins
+// its own, so only ask for them when solves are rare and nothing else is using the cores.
+struct MultiStartOptions {
+    int starts = 8;
+    int threads = 1;            // 1 solves the starts in turn, 0 uses every hardware thread
+    int abandonAfter = 3;       // Iterations before a start may be abandoned
+    double abandonFactor = 10;  // Abandon a start whose residual is this many times the best finished residual
+
+    MultiStartOptions() {};
+};
+
+// Options that apply to every solve
+struct EgoMotionOptions {
+    // If positive, the flow counts as rotation only when the residual of the best pure rotation, relative to the
+    // flow itself, is below this. The translation is then left at its initial value rather than fitted to noise,
+    // and the optimisation is skipped. Set it to the squared ratio of the flow noise to the flow, e.g. 1e-3 for
+    // tracking noise of about 3% of the flow. Zero, the default, always solves for the translation.
+    double rotationOnlyThreshold = 0;
+
+    EgoMotionOptions() {};
+};
+
 class EgoMotion {
 public:
     Vector3d linearVelocity;
@@ -33,24 +72,43 @@ public:
     double optimisedResidual = INFINITY;
     int optimisationSteps;
     int numberOfFeatures;
+    Vector3d gyroBias = Vector3d::Zero(); // Bias used with a gyro measurement
+    // False if the flow is explained by a rotation alone. The direction of linearVelocity is then unobservable,
+    // and it is left at its initial value.
+    bool translationObservable = true;
+
+    EgoMotionOptions options; // Options of this solve
 
     static constexpr double optimisationThreshold = 1e-8;
     static constexpr int maxIterations = 30;
 
     
-    EgoMotion(const vector<GIFT::Landmark>& landmarks, const double& dt=1);
-    EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const double& dt=1);
-    EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const Vector3d& initAngVel, const double& dt=1);
-    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows);
-    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel);
-    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const Vector3d& initAngVel);
+    EgoMotion(const vector<GIFT::Landmark>& landmarks, const double& dt=1, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const double& dt=1, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const Vector3d& initAngVel, const double& dt=1, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const Vector3d& initAngVel, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    // With a measured angular velocity only the direction of travel is unknown, and it has a closed form solution.
+    EgoMotion(const vector<GIFT::Landmark>& landmarks, const GyroMeasurement& gyro, const double& dt=1, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const GyroMeasurement& gyro, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    // Without an initial velocity, solve from several starts and keep the best solution.
+    EgoMotion(const vector<GIFT::Landmark>& landmarks, const MultiStartOptions& multiStart, const double& dt=1, const EgoMotionOptions& solveOptions = EgoMotionOptions());
+    EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const MultiStartOptions& multiStart, const EgoMotionOptions& solveOptions = EgoMotionOptions());
     vector<pair<Vector3d, Vector3d>> estimateFlows(const vector<GIFT::Landmark>& landmarks) const;
+    Vector3d estimateFlow(const GIFT::Landmark& landmark) const;
     vector<pair<Point2f, Vector2d>> estimateFlowsNorm(const vector<GIFT::Landmark>& landmarks) const;
     static Vector3d estimateAngularVelocity(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& linVel = Vector3d::Zero());
 
 private:
+    bool solveRotationOnly(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& linVel);
+    static double parallaxRatio(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& angVel);
     static Vector3d angularFromLinearVelocity(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel);
-    static pair<int,double> optimize(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel, Vector3d& angVel);
+    void solveWithGyro(const vector<pair<Vector3d, Vector3d>>& flows, const GyroMeasurement& gyro);
+    static Vector3d linearVelocityDirection(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& angVel);
+    void solveMultiStart(const vector<pair<Vector3d, Vector3d>>& flows, const MultiStartOptions& multiStart);
+    static pair<int,double> optimize(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel, Vector3d& angVel,
+                                     const std::atomic<double>* sharedBestResidual = nullptr, const MultiStartOptions* options = nullptr);
     static void optimizationStep(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel, Vector3d& angVel);
     static double computeResidual(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& linVel, const Vector3d& angVel);
     static bool voteForLinVelInversion(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& linVel, const Vector3d& angVel);
@@ -20,7 +20,18 @@
 #include "Landmark.h"
 #include "EgoMotion.h"
 #include "CameraParameters.h"
+#include "PyramidalLK.h"
+#include "CornerDetector.h"
+#include "OwnedMat.h"
+#include "SnapshotPublisher.h"
+#include "TrackingBudget.h"
+#include "TrackerStats.h"
+#include "TrackHistory.h"
 #include "eigen3/Eigen/Dense"
+#include <array>
+#include <memory>
+#include <optional>
+#include <utility>
 #include <vector>
 #include "opencv2/core/core.hpp"
 #include "opencv2/features2d/features2d.hpp"
@@ -34,34 +45,182 @@ namespace GIFT {
 
 Eigen::Matrix3d skew_matrix(const Eigen::Vector3d& t);
 
+// OpenCV uses calcOpticalFlowPyrLK. Builtin uses the fixed-point PyramidalLK kernels on the grey image,
+// and only supports odd square windows from 7 to 21. Choose the backend before the first image.
+enum class TrackingBackend { OpenCV, Builtin };
+
+// Whether a frame was tracked, and the time its landmark flows cover.
+struct DecimationDecision {
+    bool decimated = false;     // Tracking was skipped, so the landmarks kept their positions with zero flow
+    double imageChange = 0;     // Mean absolute grey level change since the landmarks were last tracked
+    int decimatedFrames = 0;    // Frames skipped in a row, including this one
+    double flowInterval = 1;    // Time since the landmarks were last tracked, in the units of dt (frames by default)
+};
+
+// The landmarks output by a tracker after one frame. Published snapshots are never modified.
+struct LandmarkSnapshot {
+    int frameNumber = 0;
+    vector<Landmark> landmarks;
+    BudgetDecision budgetDecision;
+    TrackerStats stats; // Of this frame only
+    DecimationDecision decimation;
+};
+
 class FeatureTracker {
 protected:
     CameraParameters camera;
 
     // Variables used in the tracking algorithms
     int currentNumber = 0;
-    Mat previousImage;
+    OwnedMat previousImage;
+    // The landmarks of the frame being processed. They are built from the last published landmarks and then
+    // published by swapping buffers with a recycled snapshot, so they are never copied to be published.
     vector<Landmark> landmarks;
     Mat imageMask;
+    vector<Rect> regionsOfInterest;
+    Rect previousCrop;
+
+    // Scratch buffers reused every frame, so that processImage does not allocate once warmed up
+    vector<Point2f> oldPoints;
+    vector<Point2f> trackedPoints;
+    vector<uchar> trackedStatus;
+    vector<float> trackedError;
+    vector<Point2f> trackedPointsNorm;
+    OwnedMat imageGrey;
+    vector<Point2f> proposedFeatures;
+    vector<Point2f> newFeaturesNorm;
+    vector<Rect> searchRegions;
+    OwnedMat previousImageGrey;
+
+    // Downscaled processing. frameScale is the processingScale applied to the current frame.
+    double frameScale = 1.0;
+    double previousScale = 1.0;
+    OwnedMat scaledImage;
+    OwnedMat previousScaledImage;
+    OwnedMat scaledMask;
+    vector<Point2f> refinementPoints;
+    vector<Point2f> refinedPoints;
+    vector<uchar> refinedStatus;
+    vector<float> refinedError;
+    PyramidalLK lkTracker;
+
+    // Target latency controller, and the stage times of the last frame
+    std::optional<TrackingBudget> budget;
+    StageTimes stageTimes;
+    int nextDetectionBand = 0;
+    vector<Point2f> bandFeatures;
+
+    // Churn and quality counters of the last frame, and their sum since the last reset
+    TrackerStats currentStats;
+    TrackerStats accumulatedStats;
+
+    // Recent positions of every landmark, if historyLength is set
+    TrackHistory history;
+
+    // Motion-adaptive decimation
+    DecimationDecision decimation;
+    double pendingInterval = 0;
+    OwnedMat changeThumbnail;
+    OwnedMat currentThumbnail;
+    OwnedMat trackedThumbnail;
+
+    // Output published to other threads after every frame. The current snapshot holds the tracker's landmarks
+    // between frames.
+    int frameNumber = 0;
+    SnapshotPublisher<LandmarkSnapshot> snapshots;
+    shared_ptr<const LandmarkSnapshot> currentSnapshot;
+
+    // Landmark positions predicted for the next frame, used as the initial LK flow
+    bool predictionAvailable = false;
+    bool predictionReliable = false;
+    vector<Point3f> predictedBearings;
+    vector<Point2f> predictedPoints;
+    Size usedTrackingWindow;
+    int usedTrackingPyramidLevels = 0;
 
 public:
+    // While a target latency is set, maxFeatures, featureSearchThreshold, detectionCoverage, trackingWindow and
+    // trackingPyramidLevels are overwritten after every frame. Set them before setTargetLatency, which takes them as
+    // the full effort; later edits are lost until it is called again.
     int maxFeatures = 500;
     double featureDist = 20;
     double minHarrisQuality = 0.1;
     double featureSearchThreshold = 1.0;
+    // Detector used for new features. If null, Shi-Tomasi corners with minHarrisQuality are used.
+    // CornerResponseCache finds the same corners but reuses the response of unchanged tiles between frames.
+    // Copying the tracker clones the detector.
+    CornerDetectorPtr cornerDetector;
+    // Fraction of the image searched each time features are detected. Below one, only some of the
+    // horizontal bands are searched, moving on each time so that the whole image is covered in turn.
+    double detectionCoverage = 1.0;
+    int detectionBands = 4;
+
+    // Pyramidal LK parameters, and the cheaper ones used when a reliable motion prediction is available
+    Size trackingWindow = Size(21,21);
+    int trackingPyramidLevels = 3;
+    Size predictedTrackingWindow = Size(11,11);
+    int predictedTrackingPyramidLevels = 1;
+    // An ego-motion prediction is reliable if its optimised residual is below this
+    double predictionResidualThreshold = 1e-4;
+    TrackingBackend trackingBackend = TrackingBackend::OpenCV;
+    // LandmarkFields to keep up to date. Ego-motion needs FlowSphere and the flow drawings need FlowRaw.
+    unsigned landmarkFields = LandmarkFields::All;
+    // Number of recent positions and bearings kept for every landmark. Zero keeps none.
+    int historyLength = 0;
+    // Images are downscaled by this factor (at most one) before tracking and detection. Landmark coordinates,
+    // featureDist, the mask and the regions of interest stay in full resolution pixels, so K does not change.
+    double processingScale = 1.0;
+    // With a reduced processingScale, refine the tracked points with one LK level at full resolution
+    bool refineAtFullResolution = false;
+    Size refinementWindow = Size(7,7);
+    // Motion-adaptive decimation. When the image has barely changed since the landmarks were last tracked,
+    // tracking and detection are skipped and the landmarks keep their positions with zero flow. The next tracked
+    // frame then measures the flow over all the frames since, as given by flowInterval().
+    bool decimateStaticFrames = false;
+    double staticChangeThreshold = 1.5;     // Largest mean absolute grey level change of a static image
+    int maxDecimatedFrames = 5;             // Frames that may be skipped in a row
+    Size changeThumbnailSize = Size(64,48); // The change is measured on thumbnails of this size
+    // Grid of image cells over which the landmark coverage is counted
+    Size coverageGrid = Size(4,4);
 
     // // Stereo Specific
     // double stereoBaseline = 0.1;
     // double stereoThreshold = 1;
 
 public:
-    // Initialisation and configuration
+    // Initialisation and configuration. A copy has its own image buffers and corner detector, so it can run
+    // on another thread than the tracker it was copied from.
     FeatureTracker(const CameraParameters &configuration = CameraParameters()) { camera = configuration; };
     void setCameraConfiguration(const CameraParameters &configuration);
 
     // Core
-    void processImage(const Mat &image);
-    vector<Landmark> outputLandmarks() const { return landmarks; };
+    void processImage(const Mat &image) { processImage(image, 1.0); };
+    // dt is the time since the previous image, which is only used for flowInterval().
+    void processImage(const Mat &image, const double& dt);
+    vector<Landmark> outputLandmarks() const { return currentLandmarks(); };
+    // Safe to call from any thread, also while processImage is running. Null before the first frame.
+    shared_ptr<const LandmarkSnapshot> latestSnapshot() const { return snapshots.latest(); };
+
+    // Adaptive effort. With a target latency (in seconds), maxFeatures, trackingPyramidLevels, trackingWindow,
+    // featureSearchThreshold and detectionCoverage are tuned after every frame, starting from their current values.
+    // clearTargetLatency restores those values.
+    void setTargetLatency(const double& targetLatency);
+    void clearTargetLatency();
+    BudgetDecision budgetDecision() const { return budget ? budget->lastDecision() : BudgetDecision(); };
+    StageTimes lastStageTimes() const { return stageTimes; };
+
+    // Decimation. Divide the landmark flows by flowInterval() to get the flow per unit time.
+    bool frameDecimated() const { return decimation.decimated; };
+    double flowInterval() const { return decimation.flowInterval; };
+    const DecimationDecision& decimationDecision() const { return decimation; };
+
+    // Statistics
+    const TrackerStats& frameStats() const { return currentStats; };
+    const TrackerStats& totalStats() const { return accumulatedStats; };
+    void resetStats() { accumulatedStats = TrackerStats(); };
+
+    // Track histories, indexed by Landmark::historySlot. Read them on the thread that calls processImage.
+    const TrackHistory& trackHistory() const { return history; };
 
     // Visualisation
     Mat drawFeatureImage(const Scalar& color = Scalar(0,0,255), const int pointSize = 2, const int thickness = 1) const;
@@ -70,18 +229,59 @@ public:
 
     // Masking
     void setMask(const Mat & mask, int cameraNumber=0);
+    // Regions of interest, in full image pixels. Landmarks that leave them are dropped. Detection only searches
+    // the regions themselves, but tracking processes the one rectangle that bounds them all, so its cost scales
+    // with that rectangle rather than with the regions' area: two small regions in opposite corners are tracked
+    // over the whole image. Use a tracker per region when the regions are far apart.
+    void setRegionOfInterest(const Rect& region) { regionsOfInterest.assign(1, region); };
+    void setRegionsOfInterest(const vector<Rect>& regions) { regionsOfInterest = regions; };
+    void clearRegionsOfInterest() { regionsOfInterest.clear(); };
 
     // EgoMotion
     EgoMotion computeEgoMotion(int minLifetime=1) const;
 
+    // Motion prediction, applied to the next call of processImage only. A reliable prediction is tracked with
+    // predictedTrackingWindow and predictedTrackingPyramidLevels, any other only seeds the full search.
+    // An ego-motion prediction is reliable if its residual is below predictionResidualThreshold. A rotation rate
+    // ignores translation, so set reliable only when the translational flow is known to be small.
+    void predictFromEgoMotion(const EgoMotion& egoMotion, const double& dt=1);
+    void predictFromAngularVelocity(const Vector3d& angularVelocity, const double& dt=1, bool reliable=false);
+    void clearPrediction() { predictionAvailable = false; };
+    // The LK window and pyramid levels of the last frame
+    Size lastTrackingWindow() const { return usedTrackingWindow; };
+    int lastTrackingPyramidLevels() const { return usedTrackingPyramidLevels; };
+
 protected:
-    vector<Point2f> detectNewFeatures(const Mat &image) const;
-    vector<Point2f> removeDuplicateFeatures(const vector<Point2f> &proposedFeatures) const;
-    vector<Landmark> createNewLandmarks(const Mat &image, const vector<Point2f>& newFeatures);
+    void detectNewFeatures(const Mat &imageGrey, const Rect &crop);
+    void detectCorners(const Mat &imageGrey, const Mat &mask, int maxCorners, double minDistance, vector<Point2f> &corners);
+    void removeDuplicateFeatures(vector<Point2f> &features) const;
+    // Bounds of the regions of interest in an image processed at the given scale
+    Rect croppedRegion(const Size& imageSize, double scale) const;
+    // Pixel centres map between the full resolution and processed images
+    Point2f toProcessed(const Point2f& point) const { return Point2f((point.x + 0.5) * frameScale - 0.5, (point.y + 0.5) * frameScale - 0.5); };
+    Point2f toFull(const Point2f& point) const { return Point2f((point.x + 0.5) / frameScale - 0.5, (point.y + 0.5) / frameScale - 0.5); };
+    static Rect scaleRegion(const Rect& region, double scale);
+    bool insideRegionsOfInterest(const Point2f& point) const;
 
-    void trackLandmarks(const Mat &image);
-    void addNewLandmarks(vector<Landmark> newLandmarks);
+    // The landmarks of the last frame, as published
+    const vector<Landmark>& currentLandmarks() const;
+    // Tracks the given landmarks of the last frame into landmarks. They may be landmarks itself.
+    void trackLandmarks(const vector<Landmark>& previous, const Mat &image, const Mat &processedImage, const Rect &crop);
+    void refineTrackedPoints(const vector<Landmark>& previous, const Mat &image);
+    template<unsigned Fields> void updateTrackedLandmarks(const vector<Landmark>& previous, const Mat &image);
+    template<size_t... Fields>
+    static constexpr std::array<void (FeatureTracker::*)(const vector<Landmark>&, const Mat&), sizeof...(Fields)> landmarkUpdaters(std::index_sequence<Fields...>) {
+        return {&FeatureTracker::updateTrackedLandmarks<Fields>...};
+    };
+    void projectPredictedBearings(bool reliable);
+    void addNewLandmarks(const Mat &image, const vector<Point2f>& newFeatures);
+    void retireLandmark(const Landmark& landmark);
+    void resetHistory();
     void computeLandmarkPositions();
+    bool decimateFrame(const Mat &image, const double& dt, size_t landmarkCount);
+    void computeCoverage(const Size& imageSize);
+    void publishSnapshot();
+    void applyEffort(const TrackingEffort& tracking, const DetectionEffort& detection);
 };
 
 }
\ No newline at end of file
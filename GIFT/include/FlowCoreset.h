@@ -0,0 +1,65 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Landmark.h"
+#include "eigen3/Eigen/Dense"
+#include <utility>
+#include <vector>
+
+namespace GIFT {
+
+// Picks a fixed size subset of flows spread evenly over the bearing sphere, to bound the cost of EgoMotion
+// and keep clusters of points from dominating it. The sphere is divided into the bins of an equi-angular
+// cube map, and the bins take turns giving up their best remaining flow until the subset is full.
+class FlowCoreset {
+public:
+    int maxFlows = 200;
+    int binsPerFaceSide = 4;    // The cube map has 6 * binsPerFaceSide^2 bins
+    // Landmarks are ranked by lifetimeWeight * log(lifetime) - errorWeight * trackingError
+    double lifetimeWeight = 1.0;
+    double errorWeight = 0.1;
+
+    // Selects from landmarks with at least minLifetime frames, giving the flows in the format EgoMotion takes.
+    const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& select(const std::vector<Landmark>& landmarks,
+                                                                           int minLifetime = 2, const double& dt = 1);
+    // Selects from flows that have no track history, such as those from DenseFlowSampler. All rank equally.
+    const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& select(const std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>>& flows);
+
+    // Indices of the selected landmarks or flows in the input of the last call to select.
+    const std::vector<int>& selectedIndices() const { return selected; };
+
+    int binOf(const Eigen::Vector3d& bearing) const;
+
+protected:
+    struct Candidate {
+        int bin;
+        double score;
+        int index;
+    };
+    void selectCandidates();
+
+    std::vector<Candidate> candidates;
+    std::vector<int> binHeads;
+    std::vector<int> binEnds;
+    std::vector<int> roundCandidates;
+    std::vector<int> selected;
+    std::vector<std::pair<Eigen::Vector3d, Eigen::Vector3d>> selectedFlows;
+};
+
+}
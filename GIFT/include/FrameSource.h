@@ -0,0 +1,142 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/videoio/videoio.hpp"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GIFT {
+
+class FrameSource {
+public:
+    virtual ~FrameSource() = default;
+    // Reads the next frame into image, reusing its buffer when the size and type match.
+    // Returns false once the source is exhausted.
+    virtual bool read(cv::Mat& image) = 0;
+    // Live sources produce frames whether or not they are read.
+    virtual bool isLive() const { return false; };
+};
+
+class VideoFrameSource : public FrameSource {
+public:
+    VideoFrameSource(const cv::String& videoFile);
+    VideoFrameSource(int cameraDevice);
+    bool read(cv::Mat& image) override { return capture.read(image); };
+    bool isLive() const override { return live; };
+
+protected:
+    cv::VideoCapture capture;
+    bool live = false;
+};
+
+class ImageDirectoryFrameSource : public FrameSource {
+public:
+    // Reads the images matching the pattern (e.g. "images/*.png") in lexicographic order.
+    ImageDirectoryFrameSource(const cv::String& pattern);
+    bool read(cv::Mat& image) override;
+
+protected:
+    std::vector<cv::String> fileNames;
+    size_t nextFile = 0;
+    std::vector<uchar> fileBuffer;
+};
+
+// Raw replay files are a RawReplayHeader followed by tightly packed frames of identical size and type.
+constexpr char rawReplayMagic[8] = {'G','I','F','T','R','A','W','1'};
+
+struct RawReplayHeader {
+    char magic[8];
+    int32_t width;
+    int32_t height;
+    int32_t type;
+    int32_t reserved;
+};
+
+class RawReplayFrameSource : public FrameSource {
+public:
+    RawReplayFrameSource(const std::string& fileName);
+    ~RawReplayFrameSource();
+    RawReplayFrameSource(const RawReplayFrameSource&) = delete;
+    RawReplayFrameSource& operator=(const RawReplayFrameSource&) = delete;
+    bool read(cv::Mat& image) override;
+
+protected:
+    FILE* file = nullptr;
+    RawReplayHeader header;
+};
+
+class RawReplayWriter {
+public:
+    RawReplayWriter(const std::string& fileName);
+    ~RawReplayWriter();
+    RawReplayWriter(const RawReplayWriter&) = delete;
+    RawReplayWriter& operator=(const RawReplayWriter&) = delete;
+    // The first frame fixes the size and type of the file.
+    void write(const cv::Mat& image);
+
+protected:
+    FILE* file = nullptr;
+    bool headerWritten = false;
+    RawReplayHeader header;
+};
+
+// Automatic drops the oldest frames for live sources and blocks the decoder otherwise.
+enum class FrameDropPolicy {Automatic, Block, DropOldest};
+
+// Decodes frames from another source on a background thread into a fixed ring of buffers.
+// Frames are handed over by swapping buffers with the caller, so neither side reallocates
+// once the ring is warm. The ring is single-producer, single-consumer and lock-free.
+class PrefetchingFrameSource : public FrameSource {
+public:
+    PrefetchingFrameSource(std::unique_ptr<FrameSource> source, int bufferCount = 4, FrameDropPolicy dropPolicy = FrameDropPolicy::Automatic);
+    ~PrefetchingFrameSource();
+    PrefetchingFrameSource(const PrefetchingFrameSource&) = delete;
+    PrefetchingFrameSource& operator=(const PrefetchingFrameSource&) = delete;
+
+    // The buffer previously held by image is returned to the ring and will be overwritten,
+    // so do not keep other headers referring to it.
+    bool read(cv::Mat& image) override;
+    bool isLive() const override { return source->isLive(); };
+    uint64_t droppedFrames() const { return dropped.load(); };
+
+protected:
+    void decodeLoop();
+
+    std::unique_ptr<FrameSource> source;
+    FrameDropPolicy dropPolicy;
+    std::vector<cv::Mat> buffers;
+
+    // head counts frames published by the decoder, tail counts frames claimed by the reader or dropped.
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> tail{0};
+    // The slot the reader is currently swapping out, or -1.
+    std::atomic<int> readerSlot{-1};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<bool> finished{false};
+    std::atomic<bool> stopping{false};
+    std::thread decodeThread;
+};
+
+}
@@ -0,0 +1,70 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace GIFT {
+
+// Flat open addressing map from landmark ids to vector indices, rebuilt every frame.
+// The table only grows, so once warmed up a rebuild is a fill and a pass over the landmarks.
+class IdIndexMap {
+public:
+    // Empties the map and makes room for count entries at a load factor of at most one half.
+    void reset(size_t count) {
+        size_t capacity = 16;
+        while (capacity < 2*count) capacity *= 2;
+        if (slots.size() < capacity) slots.resize(capacity);
+        mask = slots.size() - 1;
+        for (Slot& slot : slots) slot.id = emptyId;
+    };
+
+    // Ids must be unique and not equal to emptyId.
+    void insert(int id, int index) {
+        size_t i = hash(id);
+        while (slots[i].id != emptyId) i = (i + 1) & mask;
+        slots[i].id = id;
+        slots[i].index = index;
+    };
+
+    // Returns the index stored for the id, or -1 if there is none.
+    int find(int id) const {
+        for (size_t i = hash(id); slots[i].id != emptyId; i = (i + 1) & mask) {
+            if (slots[i].id == id) return slots[i].index;
+        }
+        return -1;
+    };
+
+    static constexpr int emptyId = INT32_MIN;
+
+protected:
+    struct Slot {
+        int id = emptyId;
+        int index = -1;
+    };
+
+    // Fibonacci hashing spreads the consecutive ids given to new landmarks over the table.
+    size_t hash(int id) const { return (size_t)(((uint64_t)(uint32_t)id * 0x9E3779B97F4A7C15ULL) >> 32) & mask; };
+
+    std::vector<Slot> slots = std::vector<Slot>(16);
+    size_t mask = 15;
+};
+
+}
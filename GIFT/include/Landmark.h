@@ -27,6 +27,20 @@ using colorVec = std::array<uchar, 3>;
 
 namespace GIFT {
 
+// Quantities derived by Landmark::update on top of the image positions, bearing and lifetime, which are always kept.
+// Fields that are not selected are not updated, and keep the values they were given when the landmark was created.
+namespace LandmarkFields {
+enum : unsigned {
+    None = 0,
+    FlowRaw = 1 << 0,       // opticalFlowRaw
+    FlowNorm = 1 << 1,      // opticalFlowNorm
+    FlowSphere = 1 << 2,    // opticalFlowSphere, needed for ego-motion
+    KeyPoint = 1 << 3,      // keypoint
+    Color = 1 << 4,         // pointColor
+    All = (1 << 5) - 1
+};
+}
+
 struct Landmark {
     cv::Point2f camCoordinates;
     cv::Point2f camCoordinatesNorm;
@@ -42,11 +56,38 @@ struct Landmark {
     colorVec pointColor;    
     int idNumber;
     int lifetime = 0;
+    float trackingError = 0; // LK error of the last tracking step
+    int historySlot = -1;    // Slot in the tracker's TrackHistory, if it keeps one
 
     Landmark() {};
     Landmark(const cv::Point2f& newCamCoords, const cv::Point2f& newCamCoordsNorm, int idNumber, const colorVec& col = {0,0,0});
+    template<unsigned Fields = LandmarkFields::All>
     void update(const cv::Point2f& newCamCoords, const cv::Point2f& newCamCoordsNorm, const colorVec& col = {0,0,0});
 
 };
 
+template<unsigned Fields>
+void Landmark::update(const cv::Point2f& newCamCoords, const cv::Point2f& newCamCoordsNorm, const colorVec& col) {
+    const Eigen::Vector2d flowNorm(newCamCoordsNorm.x - this->camCoordinatesNorm.x, newCamCoordsNorm.y - this->camCoordinatesNorm.y);
+    if constexpr ((Fields & LandmarkFields::FlowRaw) != 0) {
+        this->opticalFlowRaw << newCamCoords.x - this->camCoordinates.x, newCamCoords.y - this->camCoordinates.y;
+    }
+    if constexpr ((Fields & LandmarkFields::FlowNorm) != 0) this->opticalFlowNorm = flowNorm;
+
+    this->camCoordinates = newCamCoords;
+    this->camCoordinatesNorm = newCamCoordsNorm;
+
+    const Eigen::Vector3d bearing = Eigen::Vector3d(newCamCoordsNorm.x, newCamCoordsNorm.y, 1).normalized();
+    this->sphereCoordinates = bearing;
+    if constexpr ((Fields & LandmarkFields::FlowSphere) != 0) {
+        // z (I - bearing bearing^T) flow, without forming the projection matrix
+        const Eigen::Vector3d flow(flowNorm.x(), flowNorm.y(), 0);
+        this->opticalFlowSphere = bearing.z() * (flow - bearing * bearing.dot(flow));
+    }
+
+    if constexpr ((Fields & LandmarkFields::KeyPoint) != 0) this->keypoint.pt = this->camCoordinates;
+    if constexpr ((Fields & LandmarkFields::Color) != 0) this->pointColor = col;
+    ++lifetime;
+}
+
 }
\ No newline at end of file
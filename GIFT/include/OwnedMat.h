@@ -0,0 +1,38 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "opencv2/core/core.hpp"
+
+namespace GIFT {
+
+// A Mat whose copies clone the data instead of sharing it. Use it for buffers that are written in place,
+// so that copies of the object holding them never write into each other's buffers. Moves still take the buffer.
+class OwnedMat : public cv::Mat {
+public:
+    OwnedMat() = default;
+    OwnedMat(const OwnedMat& other) : cv::Mat(other.clone()) {};
+    OwnedMat(OwnedMat&& other) = default;
+    OwnedMat& operator=(const OwnedMat& other) {
+        if (this != &other) cv::Mat::operator=(other.clone());
+        return *this;
+    };
+    OwnedMat& operator=(OwnedMat&& other) = default;
+};
+
+}
@@ -0,0 +1,56 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "OwnedMat.h"
+#include "opencv2/core/core.hpp"
+#include <vector>
+
+namespace GIFT {
+
+// Sparse pyramidal Lucas-Kanade tracking specialised for 8-bit single channel images and
+// square windows of 7 to 21 pixels (odd sizes only).
+// Gradients and interpolation use 14-bit fixed point weights, the inner loops use AVX2 or NEON
+// when the library is compiled for them, and points are tracked in parallel.
+class PyramidalLK {
+public:
+    static constexpr int pyramidBorder = 48;
+
+    int maxIterations = 30;
+    float epsilon = 0.01f;
+    float minEigThreshold = 1e-4f;
+
+    // Builds the pyramid of a new CV_8UC1 image. The pyramid of the previous image is kept for tracking.
+    void setImage(const cv::Mat& imageGrey, int pyramidLevels);
+    bool hasPreviousImage() const { return !previousPyramid.empty(); };
+
+    // Tracks points from the previous image to the current one. If useInitialFlow is set,
+    // nextPoints must hold the initial guesses.
+    void track(const std::vector<cv::Point2f>& prevPoints, std::vector<cv::Point2f>& nextPoints,
+               std::vector<uchar>& status, std::vector<float>& error,
+               const cv::Size& window, int pyramidLevels, bool useInitialFlow = false) const;
+
+protected:
+    // Each level is stored with a reflected border of pyramidBorder pixels on every side.
+    // Copies of the tracker clone the levels.
+    std::vector<OwnedMat> previousPyramid;
+    std::vector<OwnedMat> currentPyramid;
+    std::vector<OwnedMat> levelScratch;
+};
+
+}
@@ -0,0 +1,59 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "CameraParameters.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace GIFT {
+
+struct CachedCamera {
+    CameraParameters camera;
+    cv::Size imageSize;
+    // Undistortion maps (CV_32FC1) for cv::remap. Empty unless an image size was given.
+    // When loaded from the cache they point into the read-only mapping, so do not write to them.
+    cv::Mat undistortMapX;
+    cv::Mat undistortMapY;
+    // Keeps the cache mapping alive for as long as any copy of the maps exists. Null if the maps own their data.
+    std::shared_ptr<const void> mapOwner;
+};
+
+// A binary cache of a camera rig and its derived tables, keyed by a hash of the YAML contents.
+// If the cache is missing, stale or from another version, the YAML files are parsed with
+// readCameraConfig, the tables are recomputed and the cache is rewritten.
+class RigCache {
+public:
+    RigCache(const std::vector<std::string>& cameraConfigFiles, const std::string& cacheFile, const cv::Size& imageSize = cv::Size());
+
+    const std::vector<CachedCamera>& cameras() const { return rigCameras; };
+    bool loadedFromCache() const { return cacheHit; };
+
+    static uint64_t hashConfiguration(const std::vector<std::string>& cameraConfigFiles, const cv::Size& imageSize);
+
+protected:
+    bool loadCache(const std::string& cacheFile, uint64_t contentHash, size_t cameraCount, const cv::Size& imageSize);
+    void writeCache(const std::string& cacheFile, uint64_t contentHash, const cv::Size& imageSize) const;
+
+    std::vector<CachedCamera> rigCameras;
+    bool cacheHit = false;
+};
+
+}
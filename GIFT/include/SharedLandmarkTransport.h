@@ -0,0 +1,106 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Landmark.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace GIFT {
+
+struct SharedTransportHeader;
+struct SharedFrameHeader;
+
+// A frame read in place from shared memory. The arrays are only valid while the frame has not
+// been overwritten, so check SharedLandmarkReader::stillValid after using them.
+struct SharedLandmarkFrame {
+    uint64_t sequence = 0;       // Number of frames published up to and including this one
+    int32_t frameNumber = 0;
+    uint32_t count = 0;
+    const int32_t* ids = nullptr;
+    const int32_t* lifetimes = nullptr;
+    const float* bearings = nullptr;     // count x 3, sphereCoordinates
+    const float* flows = nullptr;        // count x 3, opticalFlowSphere
+
+    // Used by the reader to validate the frame
+    const SharedFrameHeader* slot = nullptr;
+    uint32_t generation = 0;
+};
+
+// Outcome of SharedLandmarkReader::copyLatest
+enum class SharedCopyStatus {
+    Copied,     // The latest frame was copied
+    Empty,      // Nothing has been published yet
+    Contended,  // The publisher kept overwriting the frames being copied. Try again later.
+};
+
+// Publishes landmark batches to other processes through a ring of frames in POSIX shared memory.
+// Every frame has a fixed layout: a header followed by arrays of ids, lifetimes, bearings and flows.
+// Frames are guarded by a generation count (a seqlock), so readers never block the publisher and
+// can read frames in place. A reader has slotCount-1 publishes to use a frame before it is reused.
+class SharedLandmarkPublisher {
+public:
+    // Creates (or replaces) the shared memory object, e.g. "/gift_landmarks". It is removed again on destruction.
+    SharedLandmarkPublisher(const std::string& name, uint32_t maxLandmarks = 1000, uint32_t slotCount = 4);
+    ~SharedLandmarkPublisher();
+    SharedLandmarkPublisher(const SharedLandmarkPublisher&) = delete;
+    SharedLandmarkPublisher& operator=(const SharedLandmarkPublisher&) = delete;
+
+    // Landmarks past maxLandmarks are dropped.
+    void publish(int frameNumber, const std::vector<Landmark>& landmarks);
+    uint64_t publishedFrames() const { return sequence; };
+
+protected:
+    std::string name;
+    void* mappedData = nullptr;
+    size_t mappedSize = 0;
+    uint64_t sequence = 0;
+};
+
+// Reads the frames of a SharedLandmarkPublisher, in this or another process.
+class SharedLandmarkReader {
+public:
+    // Throws std::runtime_error if the shared memory object does not exist or has the wrong layout.
+    SharedLandmarkReader(const std::string& name);
+    ~SharedLandmarkReader();
+    SharedLandmarkReader(const SharedLandmarkReader&) = delete;
+    SharedLandmarkReader& operator=(const SharedLandmarkReader&) = delete;
+
+    // Number of frames published so far.
+    uint64_t publishedFrames() const;
+
+    // Finds the latest frame, or the frame with the given sequence if it is still in the ring.
+    // Returns false if there is no such frame, or it is being written.
+    bool latest(SharedLandmarkFrame& frame) const;
+    bool frame(uint64_t sequence, SharedLandmarkFrame& frame) const;
+    // True if the frame has not been overwritten since it was found. Check this after reading the arrays.
+    bool stillValid(const SharedLandmarkFrame& frame) const;
+
+    // Copies the latest frame into landmarks (only ids, lifetimes, bearings and flows are set), retrying while
+    // the publisher overwrites it. The frame number and sequence of the frame are set if the copy succeeds.
+    SharedCopyStatus copyLatest(std::vector<Landmark>& landmarks, int* frameNumber = nullptr, uint64_t* sequence = nullptr) const;
+
+protected:
+    const void* mappedData = nullptr;
+    size_t mappedSize = 0;
+    const SharedTransportHeader* header = nullptr;
+};
+
+}
@@ -0,0 +1,70 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace GIFT {
+
+// Publishes immutable, reference counted snapshots from one producer thread to any number of readers.
+// Readers take the latest snapshot without waiting for the producer and may keep it as long as they like.
+// Snapshots no reader holds any more are recycled, so their buffers are reused once warmed up.
+template<typename T>
+class SnapshotPublisher {
+public:
+    SnapshotPublisher() = default;
+    // A copy starts with the same published snapshot but its own pool.
+    SnapshotPublisher(const SnapshotPublisher& other) : published(other.latest()) {};
+    SnapshotPublisher& operator=(const SnapshotPublisher& other) {
+        if (this != &other) {
+            pool.clear();
+            std::atomic_store(&published, other.latest());
+        }
+        return *this;
+    };
+
+    // Producer only: returns a snapshot that no reader can see, to be filled in and then published.
+    std::shared_ptr<T> acquire() {
+        for (const auto& snapshot : pool) {
+            // Readers only get snapshots through published, so a count of one cannot increase again.
+            if (snapshot.use_count() == 1) {
+                // Pairs with the release of the reader's reference, so its reads finish before the reuse.
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return snapshot;
+            }
+        }
+        pool.emplace_back(std::make_shared<T>());
+        return pool.back();
+    };
+
+    // Producer only: makes the snapshot visible to readers. It must not be modified afterwards.
+    void publish(const std::shared_ptr<T>& snapshot) {
+        std::atomic_store(&published, std::shared_ptr<const T>(snapshot));
+    };
+
+    // Any thread: returns the latest published snapshot, or null if there is none yet.
+    std::shared_ptr<const T> latest() const { return std::atomic_load(&published); };
+
+protected:
+    std::vector<std::shared_ptr<T>> pool;
+    std::shared_ptr<const T> published;
+};
+
+}
@@ -19,6 +19,7 @@
 
 #include "FeatureTracker.h"
 #include "StereoLandmark.h"
+#include "IdIndexMap.h"
 
 
 using namespace Eigen;
@@ -29,48 +30,131 @@ namespace GIFT {
 
 enum class StereoCam {Left, Right};
 
+// Independent runs a full tracker on each camera. Temporal only tracks and detects in the left camera,
+// and follows the right positions of stereo landmarks with a 1D disparity update seeded from the last
+// disparity. Only new and lost points are matched in full, and points that failed to match are only tried
+// again every matchRetryInterval frames. Temporal mode needs rectified images.
+enum class StereoMode {Independent, Temporal};
+
+// The output of a stereo tracker after one frame. The left and right landmarks are the snapshots published
+// for this frame by the camera trackers, shared rather than copied.
+struct StereoLandmarkSnapshot {
+    int frameNumber = 0;
+    shared_ptr<const LandmarkSnapshot> left;
+    shared_ptr<const LandmarkSnapshot> right;
+    vector<StereoLandmark> stereoLandmarks;
+
+    const vector<Landmark>& landmarksLeft() const { return left->landmarks; };
+    const vector<Landmark>& landmarksRight() const { return right->landmarks; };
+    // The landmarks of a pair in this snapshot
+    const Landmark& landmarkLeft(const StereoLandmark& pair) const { return left->landmarks[pair.indexLeft]; };
+    const Landmark& landmarkRight(const StereoLandmark& pair) const { return right->landmarks[pair.indexRight]; };
+};
+
 class StereoFeatureTracker {
 
 protected:
     FeatureTracker trackerLeft;
     FeatureTracker trackerRight;
+    // The pairs of the frame being processed, built from the last published pairs and then swapped into
+    // the snapshot. Between frames the pairs are those of the current snapshot.
     vector<StereoLandmark> stereoLandmarks;
 
+    // Id lookups rebuilt every frame
+    IdIndexMap indicesLeft;
+    IdIndexMap indicesRight;
+
+    int frameNumber = 0;
+    SnapshotPublisher<StereoLandmarkSnapshot> snapshots;
+    shared_ptr<const StereoLandmarkSnapshot> currentSnapshot;
+
+    // Temporal mode state, reused every frame
+    CameraParameters cameraRight;
+    Mat imageMaskRight;
+    int currentStereoNumber = 0;
+    Mat greyLeft;
+    Mat greyRight;
+    vector<Landmark> landmarksRightTemporal;   // Swapped into the right snapshot, like the pairs
+    SnapshotPublisher<LandmarkSnapshot> snapshotsRightTemporal;
+    vector<int> matchedPrevious;        // Index into the last pairs, or -1 for a new pair
+    vector<size_t> matchedLeft;         // Index into the left landmarks
+    vector<Point2f> matchedRightPoints;
+    vector<Point2f> matchedRightPointsNorm;
+    vector<size_t> unmatchedLeft;
+    vector<Point2f> unmatchedLeftPoints;
+    vector<Point2f> unmatchedRightPoints;
+    vector<uchar> matchStatus;
+    vector<float> matchError;
+    // Left ids whose full match failed, and the frame from which they are matched in full again
+    vector<pair<int, int>> matchRetries;
+    vector<pair<int, int>> nextMatchRetries;
+    IdIndexMap retryIndices;
+    int lastFullMatches = 0;
+    int lastDeferredMatches = 0;
+
 public:
     // Stereo Specific
     double stereoBaseline = 0.1;
-    double stereoThreshold = 1;
+    double stereoThreshold = 1; // Largest vertical offset (pixels) of a new stereo match in temporal mode
+
+    StereoMode stereoMode = StereoMode::Independent;
+    // Temporal mode disparity update
+    int disparityWindow = 11;                   // Odd, at most 21
+    int disparityIterations = 10;
+    double maxDisparity = 128;
+    double maxDisparityChange = 4;              // Pixels per frame
+    double disparityResidualThreshold = 12;     // Mean absolute grey level difference over the window
+    int matchRetryInterval = 10;                // Frames until a point whose full match failed is matched again
 
 public:
     // Initialisation
     StereoFeatureTracker(const CameraParameters &camLeft, const CameraParameters &camRight) {
-        trackerLeft.setCameraConfiguration(camLeft);
-        trackerRight.setCameraConfiguration(camRight);
+        setCameraConfiguration(camLeft, camRight);
     };
 
     // Configuration
     void setCameraConfiguration(const CameraParameters &camLeft, const CameraParameters &camRight) {
         trackerLeft.setCameraConfiguration(camLeft);
         trackerRight.setCameraConfiguration(camRight);
+        cameraRight = camRight;
     };
     void setCameraConfiguration(const CameraParameters &configuration, StereoCam stereoCam = StereoCam::Left) {
         if (stereoCam == StereoCam::Left) trackerLeft.setCameraConfiguration(configuration);
-        else trackerRight.setCameraConfiguration(configuration);
+        else {
+            trackerRight.setCameraConfiguration(configuration);
+            cameraRight = configuration;
+        }
     }
     void setMask(const Mat & mask, StereoCam stereoCam = StereoCam::Left) {
         if (stereoCam == StereoCam::Left) trackerLeft.setMask(mask);
-        else trackerRight.setMask(mask);
+        else {
+            trackerRight.setMask(mask);
+            imageMaskRight = mask;
+        }
     }
 
     // Core
     void processImages(const Mat &imageLeft, const Mat &imageRight);
-    vector<StereoLandmark> outputStereoLandmarks() const { return stereoLandmarks; };
+    // The pairs of the last frame. Their landmarks are looked up in the snapshot of the same frame.
+    vector<StereoLandmark> outputStereoLandmarks() const { return currentStereoLandmarks(); };
+    // Safe to call from any thread, also while processImages is running. Null before the first frame.
+    shared_ptr<const StereoLandmarkSnapshot> latestSnapshot() const { return snapshots.latest(); };
+    // Temporal mode: left points matched in full by the last frame, and those skipped because their last
+    // full match failed less than matchRetryInterval frames ago.
+    int fullMatches() const { return lastFullMatches; };
+    int deferredMatches() const { return lastDeferredMatches; };
 
 protected:
-    void removeLostStereoLandmarks(const vector<Landmark>& landmarksLeft, const vector<Landmark>& landmarksRight);
+    // The pairs of the last frame, as published
+    const vector<StereoLandmark>& currentStereoLandmarks() const;
+    void updateStereoLandmarks(const vector<Landmark>& landmarksLeft, const vector<Landmark>& landmarksRight);
     vector<StereoLandmark> createNewStereoLandmarks(const vector<Landmark>& landmarksLeft, const Mat& imageLeft,
                                                     const vector<Landmark>& landmarksRight, const Mat& imageRight) const;
     void addNewStereoLandmarks(const vector<StereoLandmark>& newStereoLandmarks);
+    void propagateStereoLandmarks(const vector<Landmark>& landmarksLeft, const Mat& imageLeft, const Mat& imageRight);
+    bool refineDisparity(const Point2f& pointLeft, float& disparity) const;
+    void publishSnapshot(const shared_ptr<const LandmarkSnapshot>& snapshotLeft, const shared_ptr<const LandmarkSnapshot>& snapshotRight);
+    shared_ptr<const LandmarkSnapshot> publishRightTemporal(const LandmarkSnapshot& snapshotLeft);
 };
 
 }
\ No newline at end of file
@@ -28,17 +28,24 @@ using colorVec = std::array<uchar, 3>;
 
 namespace GIFT {
 
+// A pair of left and right landmarks that observe the same point. The landmarks are identified by their ids,
+// and by their indices in the left and right landmarks of the StereoLandmarkSnapshot the pair was published in,
+// where StereoLandmarkSnapshot::landmarkLeft and landmarkRight look them up.
 struct StereoLandmark {
-    GIFT::Landmark* landmarkLeft;
-    GIFT::Landmark* landmarkRight;
+    int idLeft = -1;
+    int idRight = -1;
+    int indexLeft = -1;
+    int indexRight = -1;
  
     int idNumberStereo;
     int lifetime = 0;
 
-    StereoLandmark();
-    StereoLandmark(GIFT::Landmark& lmLeft, GIFT::Landmark& lmRight, int idNumberStereo) {
-        this->landmarkLeft = &lmLeft;
-        this->landmarkRight = &lmRight;
+    StereoLandmark() {};
+    StereoLandmark(const GIFT::Landmark& lmLeft, int indexLeft, const GIFT::Landmark& lmRight, int indexRight, int idNumberStereo) {
+        this->idLeft = lmLeft.idNumber;
+        this->idRight = lmRight.idNumber;
+        this->indexLeft = indexLeft;
+        this->indexRight = indexRight;
         this->idNumberStereo = idNumberStereo;
     }
     // void update();
@@ -0,0 +1,61 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "eigen3/Eigen/Dense"
+#include "opencv2/core/core.hpp"
+#include <vector>
+
+namespace GIFT {
+
+// The last few image positions and bearings of every track, kept in ring buffers that all live in one
+// contiguous block. Each track owns a slot (Landmark::historySlot) until it dies, and slots are reused,
+// so keeping the history does not allocate once the tracker has warmed up.
+class TrackHistory {
+public:
+    // Clears all histories. A length of zero disables the history.
+    void reset(int length, int slotCount = 0);
+    bool enabled() const { return historyLength > 0; };
+    int length() const { return historyLength; };
+    int slotCount() const { return (int)counts.size(); };
+
+    int allocate();
+    void release(int slot);
+    void push(int slot, const cv::Point2f& position, const Eigen::Vector3d& bearing);
+
+    // Number of entries held for the slot, at most length().
+    int size(int slot) const { return counts[slot]; };
+    // Entries by age: 0 is the latest, size(slot)-1 the oldest.
+    const cv::Point2f& position(int slot, int age) const { return positions[index(slot, age)]; };
+    const Eigen::Vector3f& bearing(int slot, int age) const { return bearings[index(slot, age)]; };
+
+protected:
+    int index(int slot, int age) const {
+        const int entry = heads[slot] - age;
+        return slot*historyLength + (entry < 0 ? entry + historyLength : entry);
+    };
+
+    int historyLength = 0;
+    std::vector<cv::Point2f> positions;     // slotCount x length
+    std::vector<Eigen::Vector3f> bearings;  // slotCount x length
+    std::vector<int> heads;                 // Entry of the latest push in each slot
+    std::vector<int> counts;
+    std::vector<int> freeSlots;
+};
+
+}
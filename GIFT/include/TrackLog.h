@@ -0,0 +1,114 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "Landmark.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace GIFT {
+
+// A track log is a file header followed by one block per frame.
+// Each block is a frame header followed by the columns of that frame:
+// ids, lifetimes, pixel coordinates (x,y), normalised coordinates (x,y) and sphere flow (x,y,z).
+constexpr char trackLogMagic[8] = {'G','I','F','T','T','L','O','G'};
+constexpr uint32_t trackLogVersion = 1;
+
+struct TrackLogFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct TrackLogFrameHeader {
+    uint64_t frameIndex;
+    uint32_t count;
+    uint32_t blockBytes; // Size of the column data following this header
+};
+
+// A view of one frame of a mapped track log. The pointers are valid while the reader is alive.
+struct TrackLogFrame {
+    uint64_t frameIndex = 0;
+    uint32_t count = 0;
+    const int32_t* ids = nullptr;
+    const int32_t* lifetimes = nullptr;
+    const float* camCoordinates = nullptr;
+    const float* camCoordinatesNorm = nullptr;
+    const float* opticalFlowSphere = nullptr;
+};
+
+class TrackLogWriter {
+public:
+    TrackLogWriter(const std::string& fileName, int maxBufferedFrames = 8);
+    ~TrackLogWriter();
+    TrackLogWriter(const TrackLogWriter&) = delete;
+    TrackLogWriter& operator=(const TrackLogWriter&) = delete;
+
+    // Packs the landmarks into a free buffer and queues it for the background thread.
+    // Blocks only if all buffers are still waiting to be written.
+    void writeFrame(const std::vector<Landmark>& landmarks);
+    // Blocks until every queued frame has been written to the file.
+    // Throws if any write failed, for example because the disk is full.
+    void flush();
+    uint64_t framesWritten() const;
+    // Empty unless a write failed. writeFrame and flush throw once a write has failed.
+    std::string writeError() const;
+
+protected:
+    void writerLoop();
+
+    FILE* file = nullptr;
+    uint64_t frameCount = 0;
+    uint64_t writtenCount = 0;
+
+    std::vector<std::vector<char>> buffers;
+    std::vector<int> freeBuffers;
+    std::deque<int> queuedBuffers;
+    bool writing = false;
+    bool stopping = false;
+    std::string error;
+
+    mutable std::mutex bufferMutex;
+    std::condition_variable bufferFreed;
+    std::condition_variable bufferQueued;
+    std::thread writerThread;
+};
+
+class TrackLogReader {
+public:
+    TrackLogReader(const std::string& fileName);
+    ~TrackLogReader();
+    TrackLogReader(const TrackLogReader&) = delete;
+    TrackLogReader& operator=(const TrackLogReader&) = delete;
+
+    size_t frameCount() const { return frameOffsets.size(); };
+    TrackLogFrame frame(size_t i) const;
+
+protected:
+    const char* mappedData = nullptr;
+    size_t mappedSize = 0;
+    std::vector<size_t> frameOffsets;
+};
+
+}
@@ -0,0 +1,72 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <array>
+#include <vector>
+
+namespace GIFT {
+
+// Counters describing the churn and quality of the tracks of a FeatureTracker.
+// They are only counted and summed, so keeping them costs nothing measurable per frame.
+struct TrackerStats {
+    // Bin b holds the lifetimes in [2^b, 2^(b+1)). The last bin also holds all longer lifetimes.
+    static constexpr int lifetimeBins = 12;
+
+    int frames = 0;
+    int decimatedFrames = 0;    // Frames whose tracking was skipped because the image had not changed
+
+    // Track births and deaths by reason
+    int births = 0;
+    int lostTracking = 0;   // LK status was 0
+    int lostMask = 0;       // Tracked into the masked part of the image, or out of the regions of interest
+    int lostBudget = 0;     // Culled because maxFeatures was reduced
+
+    // Candidates from feature detection
+    int candidates = 0;
+    int rejectedDuplicate = 0;  // Too close to an existing landmark
+    int rejectedCap = 0;        // Not added because maxFeatures was reached
+
+    // LK error of the tracked landmarks
+    int trackedCount = 0;
+    double trackingErrorSum = 0;
+
+    // Lifetimes of the tracks that died
+    std::array<int, lifetimeBins> lifetimeHistogram = {};
+
+    // Number of landmarks in each cell of a coarse grid over the image, row by row.
+    // For accumulated stats, the counts are summed over the frames.
+    int coverageRows = 0;
+    int coverageCols = 0;
+    std::vector<int> coverage;
+
+    int deaths() const { return lostTracking + lostMask + lostBudget; };
+    double meanTrackingError() const { return (trackedCount > 0) ? trackingErrorSum / trackedCount : 0.0; };
+    // Fraction of the coverage cells holding at least one landmark
+    double coveredFraction() const;
+
+    static int lifetimeBin(int lifetime);
+    void recordDeath(int lifetime) { ++lifetimeHistogram[lifetimeBin(lifetime)]; };
+
+    // Clears the counters of a new frame, keeping the coverage grid and its storage.
+    void clear();
+    // Adds the counters of another set of stats, such as those of a single frame.
+    void accumulate(const TrackerStats& other);
+};
+
+}
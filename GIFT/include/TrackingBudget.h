@@ -0,0 +1,88 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "opencv2/core/core.hpp"
+#include <vector>
+
+namespace GIFT {
+
+// Time spent in each stage of FeatureTracker::processImage, in seconds.
+struct StageTimes {
+    double tracking = 0;
+    double detection = 0;
+    double total = 0;
+};
+
+struct TrackingEffort {
+    int maxFeatures;
+    int pyramidLevels;
+    cv::Size window;
+};
+
+struct DetectionEffort {
+    double featureSearchThreshold;
+    double coverage; // Fraction of the image searched for new features each time
+};
+
+enum class BudgetAction {Hold, ReduceTracking, ReduceDetection, IncreaseTracking, IncreaseDetection};
+
+struct BudgetDecision {
+    int frameNumber = 0;
+    StageTimes stageTimes;          // Of the frame that led to this decision
+    double estimatedFrameTime = 0;  // Slowest recent frame
+    int trackingLevel = 0;          // Index into the tracking ladder; 0 is full effort
+    int detectionLevel = 0;         // Index into the detection ladder; 0 is full effort
+    BudgetAction action = BudgetAction::Hold;
+};
+
+// Keeps the frame time under a target latency by stepping along ladders of tracking and detection effort.
+// Effort is cut quickly in the stage that takes longest once recent frames get close to the target,
+// and restored slowly once there is plenty of headroom.
+class TrackingBudget {
+public:
+    double targetLatency;
+    double reduceFraction = 0.9;    // Reduce effort when the slowest recent frame exceeds this fraction of the target
+    double increaseFraction = 0.6;  // Increase effort when the slowest recent frame is below this fraction
+    int recentFrames = 15;          // Frames used for the estimate
+    int reduceSettleFrames = 2;     // Frames to wait after a change before reducing again
+    int increaseSettleFrames = 30;  // Frames to wait after a change before increasing again
+
+    // Both ladders go from full effort to the cheapest settings.
+    std::vector<TrackingEffort> trackingLadder;
+    std::vector<DetectionEffort> detectionLadder;
+
+    // Builds default ladders that step down from the given full effort settings.
+    TrackingBudget(double targetLatency, const TrackingEffort& fullTracking, const DetectionEffort& fullDetection);
+
+    // Records the stage times of a frame and decides the effort for the next one.
+    const BudgetDecision& update(const StageTimes& times);
+
+    const TrackingEffort& trackingEffort() const { return trackingLadder[decision.trackingLevel]; };
+    const DetectionEffort& detectionEffort() const { return detectionLadder[decision.detectionLevel]; };
+    const BudgetDecision& lastDecision() const { return decision; };
+
+protected:
+    std::vector<StageTimes> recentTimes;
+    int recentCount = 0;
+    int nextRecent = 0;
+    int framesSinceChange = 0;
+    BudgetDecision decision;
+};
+
+}
@@ -0,0 +1,126 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "FeatureTracker.h"
+#include "EgoMotion.h"
+#include "FrameSource.h"
+#include "WorkStealingPool.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace GIFT {
+
+struct StreamOptions {
+    // Frames submitted but not yet delivered. Beyond this, submitFrame applies the drop policy.
+    size_t maxPendingFrames = 4;
+    // Block waits for room, DropOldest discards the oldest frame that has not been tracked yet.
+    // Automatic is treated as Block.
+    FrameDropPolicy dropPolicy = FrameDropPolicy::Block;
+    bool computeEgoMotion = true;
+    // Seed tracking with the previous frame's ego-motion. This runs the ego-motion straight after tracking
+    // instead of overlapping it with the tracking of the next frame.
+    bool predictFromEgoMotion = false;
+};
+
+struct StreamResult {
+    int streamId;
+    long frameIndex;    // Order of submission to the stream; dropped frames leave gaps
+    shared_ptr<const LandmarkSnapshot> landmarks;
+    std::optional<EgoMotion> egoMotion; // Empty if not computed, or if the tracker decimated the frame
+    std::string error;  // Set if processing the frame threw
+};
+
+// Runs many camera streams on one shared work-stealing pool instead of a thread per stream.
+// Each stream has its own FeatureTracker. Its frames are tracked one at a time in submission order,
+// and each job handles a single frame before going to the back of the queue, so busy streams cannot
+// starve the others. Ego-motion for a frame can overlap with tracking the stream's next frame.
+// Results are delivered through the callback in frame order per stream, on pool threads. The frame being
+// delivered stays pending until the callback returns, so a callback must not wait for the stream to make room:
+// submitFrame throws logic_error there instead of waiting, and so does waitIdle. Use trySubmitFrame or the
+// DropOldest policy to submit frames from a callback.
+class TrackingService {
+public:
+    using ResultCallback = std::function<void(const StreamResult&)>;
+
+    // The callback must not throw. Uses one thread per hardware thread if threadCount is not positive.
+    TrackingService(ResultCallback callback = nullptr, int threadCount = 0);
+    // Waits for all pending frames.
+    ~TrackingService();
+    TrackingService(const TrackingService&) = delete;
+    TrackingService& operator=(const TrackingService&) = delete;
+
+    // The stream tracks with a copy of the tracker, which has its own buffers and corner detector.
+    int addStream(const FeatureTracker& tracker, const StreamOptions& options = StreamOptions());
+
+    // Queues a frame for the stream. The image data is shared rather than copied, so do not write to it afterwards.
+    // Returns false if an older frame was dropped to make room. Throws logic_error if it would have to wait for
+    // room inside a result callback.
+    bool submitFrame(int streamId, const Mat& image);
+    // Like submitFrame, but returns false without queueing the frame instead of blocking or dropping.
+    bool trySubmitFrame(int streamId, const Mat& image);
+    // Waits until every submitted frame has been delivered. Throws logic_error inside a result callback.
+    void waitIdle();
+
+    shared_ptr<const LandmarkSnapshot> latestSnapshot(int streamId) const;
+    size_t pendingFrames(int streamId) const;
+    size_t droppedFrames(int streamId) const;
+
+protected:
+    struct Stream {
+        int id;
+        FeatureTracker tracker;
+        StreamOptions options;
+
+        std::mutex mutex;
+        std::condition_variable frameDelivered;
+        std::deque<std::pair<long, Mat>> waitingFrames;
+        std::deque<StreamResult> waitingResults;
+        size_t pendingFrames = 0;
+        size_t droppedFrames = 0;
+        long nextFrameIndex = 0;
+        bool trackingScheduled = false;
+        bool egoMotionScheduled = false;
+    };
+
+    Stream& stream(int streamId) const;
+    void queueFrame(Stream& stream, const Mat& image);
+    void runTracking(Stream& stream);
+    void runEgoMotion(Stream& stream);
+    void deliver(Stream& stream, const StreamResult& result);
+
+    ResultCallback callback;
+
+    mutable std::mutex streamsMutex;
+    std::vector<std::unique_ptr<Stream>> streams;
+
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    size_t totalPendingFrames = 0;
+
+    // Declared last so the workers stop before the streams they use are destroyed
+    WorkStealingPool pool;
+};
+
+}
@@ -0,0 +1,66 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace GIFT {
+
+// A fixed set of worker threads, each with its own job queue. Jobs submitted from a worker go to
+// its own queue, other jobs are spread over the queues, and idle workers steal from the others.
+// Every queue is first in, first out, so a job that resubmits itself waits behind the jobs already queued.
+class WorkStealingPool {
+public:
+    // Uses one thread per hardware thread if threadCount is not positive.
+    WorkStealingPool(int threadCount = 0);
+    ~WorkStealingPool();
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // Jobs must not throw.
+    void submit(std::function<void()> job);
+    int threadCount() const { return threads.size(); };
+
+protected:
+    struct WorkerQueue {
+        std::mutex mutex;
+        std::deque<std::function<void()>> jobs;
+    };
+
+    void workerLoop(int index);
+    bool takeJob(int index, std::function<void()>& job);
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::vector<std::thread> threads;
+    std::atomic<size_t> nextQueue{0};
+
+    // Idle workers sleep until a job is queued
+    std::atomic<size_t> queuedJobs{0};
+    std::mutex sleepMutex;
+    std::condition_variable jobQueued;
+    bool stopping = false;
+};
+
+}
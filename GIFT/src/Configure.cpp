@@ -45,11 +45,7 @@ CameraParameters GIFT::readCameraConfig(const std::string &fileName) {
     CameraParameters cam = CameraParameters(cvK, pose);
 
     if (config["distortionParams"]) {
-        std::vector<double> distortionParams;
-        for (int i=0; i<config["distortionParams"].size(); ++i) {
-            distortionParams.emplace_back(config["distortionParams"][i].as<double>());
-        }
-        cam.distortionParams = distortionParams;
+        cam.distortionParams = config["distortionParams"].as<std::vector<double>>();
     }
 
     return cam;
@@ -58,11 +54,16 @@ CameraParameters GIFT::readCameraConfig(const std::string &fileName) {
 Eigen::MatrixXd GIFT::convertYamlToMatrix(YAML::Node yaml) {
     int m = yaml["rows"].as<int>();
     int n = yaml["cols"].as<int>();
+    // Convert the data sequence in one pass rather than looking up each element by index.
+    const std::vector<double> data = yaml["data"].as<std::vector<double>>();
+    if (data.size() != m*n) {
+        throw std::invalid_argument( "The matrix data does not match the given rows and cols." );
+    }
     Eigen::MatrixXd mat(m, n);
     int k = 0;
     for (int i=0;i<m;++i) {
         for (int j=0;j<n;++j) {
-            mat(i,j) = yaml["data"][k].as<double>();
+            mat(i,j) = data[k];
             ++k;
         }
     }
@@ -0,0 +1,283 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CornerDetector.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace GIFT;
+using namespace std;
+using namespace cv;
+
+void CornerSpacingGrid::reset(const Size& imageSize, double minDistance) {
+    minDistanceSq = minDistance * minDistance;
+    cellSize = max(minDistance, 1.0);
+    cols = (int)ceil(imageSize.width / cellSize) + 1;
+    rows = (int)ceil(imageSize.height / cellSize) + 1;
+    cellHeads.assign(cols * rows, -1);
+    nextInCell.clear();
+    points.clear();
+}
+
+bool CornerSpacingGrid::tryInsert(const Point2f& point) {
+    const int cx = min(max((int)(point.x / cellSize), 0), cols - 1);
+    const int cy = min(max((int)(point.y / cellSize), 0), rows - 1);
+
+    // Cells are at least minDistance wide, so only the neighbouring cells can hold a point that is too close.
+    if (minDistanceSq > 0) {
+        for (int y = max(cy - 1, 0); y <= min(cy + 1, rows - 1); ++y) {
+            for (int x = max(cx - 1, 0); x <= min(cx + 1, cols - 1); ++x) {
+                for (int i = cellHeads[y*cols + x]; i >= 0; i = nextInCell[i]) {
+                    const Point2f offset = points[i] - point;
+                    if (offset.x*offset.x + offset.y*offset.y < minDistanceSq) return false;
+                }
+            }
+        }
+    }
+
+    const int cell = cy*cols + cx;
+    nextInCell.emplace_back(cellHeads[cell]);
+    cellHeads[cell] = points.size();
+    points.emplace_back(point);
+    return true;
+}
+
+void ShiTomasiDetector::detect(const Mat& imageGrey, const Mat& mask, int maxCorners, double minDistance,
+                               vector<Point2f>& corners) {
+    goodFeaturesToTrack(imageGrey, corners, maxCorners, qualityLevel, minDistance, mask, blockSize);
+}
+
+shared_ptr<CornerDetector> ShiTomasiDetector::clone() const {
+    return make_shared<ShiTomasiDetector>(*this);
+}
+
+CornerResponseCache::CornerResponseCache(int tileSize, double changeThreshold)
+    : tileSize(tileSize), changeThreshold(changeThreshold) {
+    if (tileSize <= 0) throw invalid_argument("The corner response tiles must be at least one pixel wide.");
+}
+
+shared_ptr<CornerDetector> CornerResponseCache::clone() const {
+    shared_ptr<CornerResponseCache> copy = make_shared<CornerResponseCache>(tileSize, changeThreshold);
+    copy->qualityLevel = qualityLevel;
+    copy->blockSize = blockSize;
+    return copy;
+}
+
+void CornerResponseCache::clear() {
+    tileValid.assign(tileValid.size(), 0);
+    referenceValid.assign(referenceValid.size(), 0);
+}
+
+void CornerResponseCache::refreshTiles(const Mat& wholeGrey, const Rect& region) {
+    // The Sobel and box filters reach this far, so each tile is computed with a margin of its neighbours
+    // and matches the map of the whole image.
+    const int margin = blockSize/2 + 2;
+    const int reach = (margin + tileSize - 1) / tileSize;
+    const Rect imageRect(Point(0,0), wholeGrey.size());
+    const int row0 = region.y / tileSize;
+    const int row1 = (region.br().y - 1) / tileSize;
+    const int col0 = region.x / tileSize;
+    const int col1 = (region.br().x - 1) / tileSize;
+
+    // A change in a tile makes the response of every tile within reach of it stale, so look for changes
+    // that far around the region as well.
+    for (int row = max(row0 - reach, 0); row <= min(row1 + reach, tileRows - 1); ++row) {
+        for (int col = max(col0 - reach, 0); col <= min(col1 + reach, tileCols - 1); ++col) {
+            const Rect tile = Rect(col*tileSize, row*tileSize, tileSize, tileSize) & imageRect;
+            uchar& seen = referenceValid[row*tileCols + col];
+            if (seen && norm(wholeGrey(tile), reference(tile), NORM_L1) <= changeThreshold * tile.area()) continue;
+
+            // The destination is a view into the cache, so copying writes through to it.
+            Mat referenceTile = reference(tile);
+            wholeGrey(tile).copyTo(referenceTile);
+            seen = 1;
+            for (int r = max(row - reach, 0); r <= min(row + reach, tileRows - 1); ++r) {
+                for (int c = max(col - reach, 0); c <= min(col + reach, tileCols - 1); ++c) tileValid[r*tileCols + c] = 0;
+            }
+        }
+    }
+
+    for (int row = row0; row <= row1; ++row) {
+        for (int col = col0; col <= col1; ++col) {
+            uchar& valid = tileValid[row*tileCols + col];
+            if (valid) {
+                ++lastReused;
+                continue;
+            }
+
+            const Rect tile = Rect(col*tileSize, row*tileSize, tileSize, tileSize) & imageRect;
+            const Rect expanded = Rect(tile.x - margin, tile.y - margin, tile.width + 2*margin, tile.height + 2*margin) & imageRect;
+            cornerMinEigenVal(wholeGrey(expanded), tileResponse, blockSize);
+            Mat responseTile = response(tile);
+            tileResponse(tile - expanded.tl()).copyTo(responseTile);
+            valid = 1;
+            ++lastRecomputed;
+        }
+    }
+}
+
+void CornerResponseCache::detect(const Mat& imageGrey, const Mat& mask, int maxCorners, double minDistance,
+                                 vector<Point2f>& corners) {
+    corners.clear();
+    lastRecomputed = 0;
+    lastReused = 0;
+    if (imageGrey.empty() || maxCorners <= 0) return;
+    if (imageGrey.type() != CV_8UC1) throw invalid_argument("The corner response cache needs a CV_8UC1 image.");
+
+    // Find the whole image that imageGrey is a region of.
+    Size wholeSize;
+    Point offset;
+    imageGrey.locateROI(wholeSize, offset);
+    Mat wholeGrey = imageGrey;
+    wholeGrey.adjustROI(offset.y, wholeSize.height - offset.y - imageGrey.rows, offset.x, wholeSize.width - offset.x - imageGrey.cols);
+
+    if (wholeSize != cachedSize) {
+        cachedSize = wholeSize;
+        tileCols = (wholeSize.width + tileSize - 1) / tileSize;
+        tileRows = (wholeSize.height + tileSize - 1) / tileSize;
+        tileValid.assign(tileCols * tileRows, 0);
+        referenceValid.assign(tileCols * tileRows, 0);
+        response.create(wholeSize, CV_32FC1);
+        reference.create(wholeSize, CV_8UC1);
+    }
+
+    // One pixel more is needed around the region for the local maximum test.
+    const Rect region(offset, imageGrey.size());
+    const Rect wholeRect(Point(0,0), wholeSize);
+    refreshTiles(wholeGrey, Rect(region.x - 1, region.y - 1, region.width + 2, region.height + 2) & wholeRect);
+
+    const Mat regionResponse = response(region);
+    double maxResponse = 0;
+    minMaxLoc(regionResponse, nullptr, &maxResponse, nullptr, nullptr, mask);
+    const float threshold = qualityLevel * maxResponse;
+
+    // Local maxima above the quality threshold, away from the border of the whole image.
+    candidates.clear();
+    const int x0 = max(region.x, 1);
+    const int x1 = min(region.br().x, wholeSize.width - 1);
+    for (int y = max(region.y, 1); y < min(region.br().y, wholeSize.height - 1); ++y) {
+        const float* above = response.ptr<float>(y - 1);
+        const float* centre = response.ptr<float>(y);
+        const float* below = response.ptr<float>(y + 1);
+        const uchar* maskRow = mask.empty() ? nullptr : mask.ptr<uchar>(y - region.y);
+        for (int x = x0; x < x1; ++x) {
+            const float value = centre[x];
+            if (value <= threshold || (maskRow && maskRow[x - region.x] == 0)) continue;
+            const bool localMaximum = value >= above[x-1] && value >= above[x] && value >= above[x+1]
+                && value >= centre[x-1] && value >= centre[x+1]
+                && value >= below[x-1] && value >= below[x] && value >= below[x+1];
+            if (localMaximum) candidates.emplace_back(value, Point(x - region.x, y - region.y));
+        }
+    }
+    sort(candidates.begin(), candidates.end(),
+         [](const pair<float, Point>& a, const pair<float, Point>& b) { return a.first > b.first; });
+
+    spacing.reset(imageGrey.size(), minDistance);
+    for (const auto& candidate : candidates) {
+        if ((int)corners.size() >= maxCorners) break;
+        const Point2f corner(candidate.second);
+        if (spacing.tryInsert(corner)) corners.emplace_back(corner);
+    }
+}
+
+void KeyPointCornerDetector::detect(const Mat& imageGrey, const Mat& mask, int maxCorners, double minDistance,
+                                    vector<Point2f>& corners) {
+    corners.clear();
+    detectKeyPoints(imageGrey, keyPoints);
+    sort(keyPoints.begin(), keyPoints.end(),
+         [](const KeyPoint& a, const KeyPoint& b) { return a.response > b.response; });
+
+    spacing.reset(imageGrey.size(), minDistance);
+    for (const KeyPoint& keyPoint : keyPoints) {
+        if ((int)corners.size() >= maxCorners) break;
+        if (!mask.empty() && mask.at<uchar>(Point(keyPoint.pt)) == 0) continue;
+        if (spacing.tryInsert(keyPoint.pt)) corners.emplace_back(keyPoint.pt);
+    }
+}
+
+FASTDetector::FASTDetector(int threshold, bool nonmaxSuppression)
+    : threshold(threshold), nonmaxSuppression(nonmaxSuppression) {
+    detector = FastFeatureDetector::create(threshold, nonmaxSuppression);
+}
+
+shared_ptr<CornerDetector> FASTDetector::clone() const {
+    return make_shared<FASTDetector>(threshold, nonmaxSuppression);
+}
+
+void FASTDetector::detectKeyPoints(const Mat& imageGrey, vector<KeyPoint>& keyPoints) {
+    detector->setThreshold(threshold);
+    detector->setNonmaxSuppression(nonmaxSuppression);
+    detector->detect(imageGrey, keyPoints);
+}
+
+AGASTDetector::AGASTDetector(int threshold, bool nonmaxSuppression)
+    : threshold(threshold), nonmaxSuppression(nonmaxSuppression) {
+    detector = AgastFeatureDetector::create(threshold, nonmaxSuppression);
+}
+
+shared_ptr<CornerDetector> AGASTDetector::clone() const {
+    return make_shared<AGASTDetector>(threshold, nonmaxSuppression);
+}
+
+void AGASTDetector::detectKeyPoints(const Mat& imageGrey, vector<KeyPoint>& keyPoints) {
+    detector->setThreshold(threshold);
+    detector->setNonmaxSuppression(nonmaxSuppression);
+    detector->detect(imageGrey, keyPoints);
+}
+
+GridDetector::GridDetector(shared_ptr<CornerDetector> cellDetector, int gridRows, int gridCols)
+    : cellDetector(cellDetector), gridRows(gridRows), gridCols(gridCols) {
+    if (!this->cellDetector) throw invalid_argument("The grid detector needs a cell detector.");
+    if (gridRows <= 0 || gridCols <= 0) throw invalid_argument("The grid must have at least one cell.");
+}
+
+shared_ptr<CornerDetector> GridDetector::clone() const {
+    return make_shared<GridDetector>(cellDetector->clone(), gridRows, gridCols);
+}
+
+void GridDetector::detect(const Mat& imageGrey, const Mat& mask, int maxCorners, double minDistance,
+                          vector<Point2f>& corners) {
+    corners.clear();
+    spacing.reset(imageGrey.size(), minDistance);
+
+    const int cellCount = gridRows * gridCols;
+    for (int row = 0; row < gridRows; ++row) {
+        for (int col = 0; col < gridCols; ++col) {
+            const int cellIndex = row*gridCols + col;
+            const int cellQuota = maxCorners / cellCount + (cellIndex < maxCorners % cellCount ? 1 : 0);
+            if (cellQuota == 0) continue;
+
+            const int x0 = col * imageGrey.cols / gridCols;
+            const int x1 = (col + 1) * imageGrey.cols / gridCols;
+            const int y0 = row * imageGrey.rows / gridRows;
+            const int y1 = (row + 1) * imageGrey.rows / gridRows;
+            const Rect cell(x0, y0, x1 - x0, y1 - y0);
+            if (cell.area() == 0) continue;
+
+            cellDetector->detect(imageGrey(cell), mask.empty() ? mask : mask(cell), cellQuota, minDistance, cellCorners);
+
+            // Corners on either side of a cell edge can still be too close together.
+            const Point2f offset(x0, y0);
+            for (const Point2f& cellCorner : cellCorners) {
+                const Point2f corner = cellCorner + offset;
+                if (spacing.tryInsert(corner)) corners.emplace_back(corner);
+            }
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DenseFlowSampler.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+
+using namespace GIFT;
+using namespace std;
+using namespace cv;
+using namespace Eigen;
+
+void DenseFlowSampler::setCameraConfiguration(const CameraParameters &configuration) {
+    camera = configuration;
+    gridImageSize = Size();
+}
+
+void DenseFlowSampler::setMask(const Mat& mask) {
+    imageMask = mask;
+    gridImageSize = Size();
+}
+
+bool DenseFlowSampler::processImage(const Mat& image) {
+    swap(previousGrey, currentGrey);
+    if (image.channels() == 1) image.copyTo(currentGrey);
+    else cvtColor(image, currentGrey, COLOR_BGR2GRAY);
+
+    flows.clear();
+    if (previousGrey.empty() || previousGrey.size() != currentGrey.size()) return false;
+
+#if CV_VERSION_MAJOR >= 4
+    if (!flowMethod || flowMethodQuality != quality) {
+        const int preset = (quality == DenseFlowQuality::UltraFast) ? DISOpticalFlow::PRESET_ULTRAFAST
+                         : (quality == DenseFlowQuality::Fast) ? DISOpticalFlow::PRESET_FAST
+                         : DISOpticalFlow::PRESET_MEDIUM;
+        flowMethod = DISOpticalFlow::create(preset);
+        flowMethodQuality = quality;
+    }
+    flowMethod->calc(previousGrey, currentGrey, flow);
+#else
+    // DIS is only in the contrib modules before OpenCV 4. Farneback with fewer levels and iterations is the faster end.
+    const int levels = (quality == DenseFlowQuality::Medium) ? 4 : 3;
+    const int iterations = (quality == DenseFlowQuality::UltraFast) ? 1 : (quality == DenseFlowQuality::Fast) ? 2 : 3;
+    calcOpticalFlowFarneback(previousGrey, currentGrey, flow, 0.5, levels, 15, iterations, 5, 1.1, 0);
+#endif
+
+    updateGrid(currentGrey.size());
+
+    // Move the samples along the flow and keep those that stay in the image.
+    movedPoints.clear();
+    movedSamples.clear();
+    const double maxFlowSq = maxFlow*maxFlow;
+    for (size_t i = 0; i < gridPoints.size(); ++i) {
+        const Point2f& point = gridPoints[i];
+        const Point2f& pointFlow = flow.at<Point2f>(Point(point));
+        const Point2f moved = point + pointFlow;
+        if (!(pointFlow.x*pointFlow.x + pointFlow.y*pointFlow.y <= maxFlowSq)) continue; // Also rejects NaN
+        if (moved.x < 0 || moved.y < 0 || moved.x > currentGrey.cols - 1 || moved.y > currentGrey.rows - 1) continue;
+        if (!imageMask.empty() && imageMask.at<uchar>(Point(moved)) == 0) continue;
+        movedPoints.emplace_back(moved);
+        movedSamples.emplace_back(i);
+    }
+    if (movedPoints.empty()) return true;
+    undistortPoints(movedPoints, movedPointsNorm, camera.K, camera.distortionParams);
+
+    // The same sphere flow as Landmark::update computes for tracked features.
+    for (size_t j = 0; j < movedPoints.size(); ++j) {
+        const Point2f& startNorm = gridPointsNorm[movedSamples[j]];
+        const Point2f& endNorm = movedPointsNorm[j];
+        const Vector3d bearing = Vector3d(endNorm.x, endNorm.y, 1).normalized();
+        const Vector3d flowNorm(endNorm.x - startNorm.x, endNorm.y - startNorm.y, 0);
+        flows.emplace_back(bearing, bearing.z() * (flowNorm - bearing * bearing.dot(flowNorm)));
+    }
+    return true;
+}
+
+void DenseFlowSampler::updateGrid(const Size& imageSize) {
+    if (imageSize == gridImageSize && gridSpacing == gridImageSpacing) return;
+    gridImageSize = imageSize;
+    gridImageSpacing = gridSpacing;
+
+    // Samples are centred in their cells and masked in the previous image.
+    gridPoints.clear();
+    const int spacing = max(gridSpacing, 1);
+    for (int y = spacing / 2; y < imageSize.height; y += spacing) {
+        for (int x = spacing / 2; x < imageSize.width; x += spacing) {
+            if (!imageMask.empty() && imageMask.at<uchar>(y, x) == 0) continue;
+            gridPoints.emplace_back(x, y);
+        }
+    }
+    if (!gridPoints.empty()) undistortPoints(gridPoints, gridPointsNorm, camera.K, camera.distortionParams);
+}
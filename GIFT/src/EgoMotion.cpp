@@ -18,16 +18,19 @@
 #include "EgoMotion.h"
 #include <utility>
 #include <iostream>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 using namespace Eigen;
 using namespace cv;
 using namespace GIFT;
 
-EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows) {
+EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     Vector3d linVel(0,0,1);
     Vector3d angVel(0,0,0);
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -37,10 +40,11 @@ EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows) {
     this->numberOfFeatures = sphereFlows.size();
 }
 
-EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel) {
+EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     Vector3d linVel = initLinVel;
     Vector3d angVel = estimateAngularVelocity(sphereFlows, linVel);
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -50,10 +54,11 @@ EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const
     this->numberOfFeatures = sphereFlows.size();
 }
 
-EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const Vector3d& initAngVel) {
+EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& initLinVel, const Vector3d& initAngVel, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     Vector3d linVel = initLinVel;
     Vector3d angVel = initAngVel;
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -63,7 +68,7 @@ EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const
     this->numberOfFeatures = sphereFlows.size();
 }
 
-EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const double& dt) {
+EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const double& dt, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     vector<pair<Vector3d, Vector3d>> sphereFlows;
     for (const auto& lm: landmarks) {
         if (lm.lifetime < 2) continue;
@@ -73,6 +78,7 @@ EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const double& dt) {
     Vector3d linVel(0,0,1);
     Vector3d angVel(0,0,0);
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -83,7 +89,7 @@ EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const double& dt) {
 
 }
 
-EgoMotion::EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const double& dt) {
+EgoMotion::EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& initLinVel, const double& dt, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     vector<pair<Vector3d, Vector3d>> sphereFlows;
     for (const auto& lm: landmarks) {
         if (lm.lifetime < 2) continue;
@@ -93,6 +99,7 @@ EgoMotion::EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& in
     Vector3d linVel = initLinVel;
     Vector3d angVel = estimateAngularVelocity(sphereFlows, linVel);
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -102,7 +109,7 @@ EgoMotion::EgoMotion(const vector<GIFT::Landmark>& landmarks, const Vector3d& in
     this->numberOfFeatures = sphereFlows.size();
 }
 
-EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const Vector3d& initLinVel, const Vector3d& initAngVel, const double& dt) {
+EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const Vector3d& initLinVel, const Vector3d& initAngVel, const double& dt, const EgoMotionOptions& solveOptions) : options(solveOptions) {
     vector<pair<Vector3d, Vector3d>> sphereFlows;
     for (const auto& lm: landmarks) {
         if (lm.lifetime < 2) continue;
@@ -111,6 +118,7 @@ EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const Vector3d& ini
     Vector3d linVel = initLinVel;
     Vector3d angVel = initAngVel;
 
+    if (solveRotationOnly(sphereFlows, linVel)) return;
     pair<int, double> stepResPair = optimize(sphereFlows, linVel, angVel);
     
     this->optimisedResidual = stepResPair.second;
@@ -120,7 +128,164 @@ EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const Vector3d& ini
     this->numberOfFeatures = sphereFlows.size();
 }
 
-pair<int,double> EgoMotion::optimize(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel, Vector3d& angVel) {
+EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const GyroMeasurement& gyro, const double& dt, const EgoMotionOptions& solveOptions) : options(solveOptions) {
+    vector<pair<Vector3d, Vector3d>> sphereFlows;
+    for (const auto& lm: landmarks) {
+        if (lm.lifetime < 2) continue;
+        sphereFlows.emplace_back(make_pair(lm.sphereCoordinates,lm.opticalFlowSphere/dt));
+    }
+    solveWithGyro(sphereFlows, gyro);
+}
+
+EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const GyroMeasurement& gyro, const EgoMotionOptions& solveOptions) : options(solveOptions) {
+    solveWithGyro(sphereFlows, gyro);
+}
+
+EgoMotion::EgoMotion(const std::vector<Landmark>& landmarks, const MultiStartOptions& multiStart, const double& dt, const EgoMotionOptions& solveOptions) : options(solveOptions) {
+    vector<pair<Vector3d, Vector3d>> sphereFlows;
+    for (const auto& lm: landmarks) {
+        if (lm.lifetime < 2) continue;
+        sphereFlows.emplace_back(make_pair(lm.sphereCoordinates,lm.opticalFlowSphere/dt));
+    }
+    solveMultiStart(sphereFlows, multiStart);
+}
+
+EgoMotion::EgoMotion(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const MultiStartOptions& multiStart, const EgoMotionOptions& solveOptions) : options(solveOptions) {
+    solveMultiStart(sphereFlows, multiStart);
+}
+
+void EgoMotion::solveMultiStart(const vector<pair<Vector3d, Vector3d>>& flows, const MultiStartOptions& multiStart) {
+    if (solveRotationOnly(flows, Vector3d(0,0,1))) return;
+    const int startCount = max(multiStart.starts, 1);
+
+    // Fibonacci points on the forward hemisphere, starting close to the optical axis.
+    struct Start {
+        Vector3d linVel;
+        Vector3d angVel;
+        pair<int, double> stepResPair;
+    };
+    vector<Start> starts(startCount);
+    const double goldenAngle = M_PI * (3.0 - sqrt(5.0));
+    for (int k = 0; k < startCount; ++k) {
+        const double z = 1.0 - (k + 0.5) / startCount;
+        const double r = sqrt(max(1.0 - z*z, 0.0));
+        starts[k].linVel = Vector3d(r*cos(k*goldenAngle), r*sin(k*goldenAngle), z);
+    }
+
+    atomic<double> bestResidual(INFINITY);
+    atomic<int> nextStart(0);
+    auto solveStarts = [&]() {
+        for (int k = nextStart++; k < startCount; k = nextStart++) {
+            Start& start = starts[k];
+            start.angVel = estimateAngularVelocity(flows, start.linVel);
+            start.stepResPair = optimize(flows, start.linVel, start.angVel, &bestResidual, &multiStart);
+
+            double current = bestResidual.load();
+            while (start.stepResPair.second < current && !bestResidual.compare_exchange_weak(current, start.stepResPair.second)) {}
+        }
+    };
+
+    int threadCount = (multiStart.threads > 0) ? multiStart.threads : (int)thread::hardware_concurrency();
+    threadCount = min(max(threadCount, 1), startCount);
+    vector<thread> workers;
+    for (int i = 1; i < threadCount; ++i) workers.emplace_back(solveStarts);
+    solveStarts();
+    for (auto& worker : workers) worker.join();
+
+    const Start& best = *min_element(starts.begin(), starts.end(), [](const Start& a, const Start& b) {
+        return a.stepResPair.second < b.stepResPair.second;
+    });
+    this->optimisedResidual = best.stepResPair.second;
+    this->optimisationSteps = best.stepResPair.first;
+    this->linearVelocity = best.linVel;
+    this->angularVelocity = best.angVel;
+    this->numberOfFeatures = flows.size();
+}
+
+void EgoMotion::solveWithGyro(const vector<pair<Vector3d, Vector3d>>& flows, const GyroMeasurement& gyro) {
+    // The residual of each flow is wHat.dot((phi + angVel x eta) x eta) = wHat.dot(phi x eta) - a.dot(angVel)
+    // with a = (I - eta eta^T) wHat. It is linear in the bias for a fixed wHat, so with bias estimation
+    // wHat and the bias are refined in turn.
+    Vector3d bias = gyro.bias;
+    Vector3d angVel = gyro.angularVelocity - bias;
+    Vector3d wHat = linearVelocityDirection(flows, angVel);
+
+    int iteration = 1;
+    if (gyro.estimateBias && !flows.empty()) {
+        constexpr int biasIterations = 5;
+        for (; iteration <= biasIterations; ++iteration) {
+            Matrix3d A = gyro.biasRegularisation * Matrix3d::Identity();
+            Vector3d g = gyro.biasRegularisation * gyro.bias;
+            for (const auto& flow : flows) {
+                const Vector3d& eta = flow.first;
+                const Vector3d a = wHat - eta * eta.dot(wHat);
+                const double c = wHat.dot(flow.second.cross(eta)) - a.dot(gyro.angularVelocity);
+                A += a * a.transpose() / flows.size();
+                g -= a * c / flows.size();
+            }
+            const Vector3d newBias = A.ldlt().solve(g);
+            const bool converged = (newBias - bias).norm() < 1e-9;
+            bias = newBias;
+            angVel = gyro.angularVelocity - bias;
+            wHat = linearVelocityDirection(flows, angVel);
+            if (converged) break;
+        }
+    }
+
+    Vector3d linVel = wHat;
+    if (voteForLinVelInversion(flows, linVel, angVel)) linVel = -linVel;
+
+    this->linearVelocity = linVel;
+    this->angularVelocity = angVel;
+    this->gyroBias = bias;
+    this->translationObservable = (options.rotationOnlyThreshold <= 0 || parallaxRatio(flows, angVel) > options.rotationOnlyThreshold);
+    this->optimisedResidual = computeResidual(flows, linVel, angVel);
+    this->optimisationSteps = iteration;
+    this->numberOfFeatures = flows.size();
+}
+
+bool EgoMotion::solveRotationOnly(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& linVel) {
+    if (options.rotationOnlyThreshold <= 0) return false;
+    // Without parallax the closed form angular velocity explains the flow, and no linear velocity can improve on it.
+    const Vector3d angVel = flows.empty() ? Vector3d::Zero() : estimateAngularVelocity(flows);
+    if (parallaxRatio(flows, angVel) > options.rotationOnlyThreshold) return false;
+
+    this->translationObservable = false;
+    this->linearVelocity = linVel;
+    this->angularVelocity = angVel;
+    this->optimisedResidual = computeResidual(flows, linVel, angVel);
+    this->optimisationSteps = 0;
+    this->numberOfFeatures = flows.size();
+    return true;
+}
+
+double EgoMotion::parallaxRatio(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& angVel) {
+    // phi + angVel x eta is the part of the flow due to translation.
+    double flowEnergy = 0;
+    double translationEnergy = 0;
+    for (const auto& flow : flows) {
+        flowEnergy += flow.second.squaredNorm();
+        translationEnergy += (flow.second + angVel.cross(flow.first)).squaredNorm();
+    }
+    return (flowEnergy > 0) ? translationEnergy / flowEnergy : 0.0;
+}
+
+Vector3d EgoMotion::linearVelocityDirection(const vector<pair<Vector3d, Vector3d>>& flows, const Vector3d& angVel) {
+    // The residual is the mean of (wHat.dot(z))^2 with z = (phi + angVel x eta) x eta, so the best
+    // unit wHat is the eigenvector of sum(z z^T) with the smallest eigenvalue.
+    Matrix3d scatter = Matrix3d::Zero();
+    for (const auto& flow : flows) {
+        const Vector3d z = (flow.second + angVel.cross(flow.first)).cross(flow.first);
+        scatter += z * z.transpose();
+    }
+    if (flows.empty()) return Vector3d(0,0,1);
+
+    SelfAdjointEigenSolver<Matrix3d> eigenSolver(scatter);
+    return eigenSolver.eigenvectors().col(0).normalized();
+}
+
+pair<int,double> EgoMotion::optimize(const vector<pair<Vector3d, Vector3d>>& flows, Vector3d& linVel, Vector3d& angVel,
+                                     const atomic<double>* sharedBestResidual, const MultiStartOptions* options) {
     double lastResidual = 1e8;
     double residual = computeResidual(flows, linVel, angVel);
 
@@ -144,6 +309,10 @@ pair<int,double> EgoMotion::optimize(const vector<pair<Vector3d, Vector3d>>& flo
             bestAngVel = angVel;
             optimisationSteps = iteration;
         }
+
+        // In a multi-start solve, give up on a start that is still far worse than one that has finished.
+        if (sharedBestResidual && iteration >= options->abandonAfter
+            && bestResidual > options->abandonFactor * sharedBestResidual->load(memory_order_relaxed)) break;
     }
 
     linVel = bestLinVel;
@@ -241,24 +410,28 @@ vector<pair<Point2f, Vector2d>> EgoMotion::estimateFlowsNorm(const vector<GIFT::
 }
 
 vector<pair<Vector3d, Vector3d>> EgoMotion::estimateFlows(const vector<GIFT::Landmark>& landmarks) const {
-    auto Proj3 = [](const Vector3d& vec) { return Matrix3d::Identity() - vec*vec.transpose()/vec.squaredNorm(); };
-
     vector<pair<Vector3d, Vector3d>> estFlows;
 
     for (const auto& lm: landmarks) {
-        const Vector3d& eta = lm.sphereCoordinates;
-        const Vector3d etaVel = Proj3(eta) * this->linearVelocity;
-
-        double invDepth = 0;
-        if (etaVel.norm() > 0) invDepth = -etaVel.dot(lm.opticalFlowSphere + this->angularVelocity.cross(eta)) / etaVel.squaredNorm();
-
-        Vector3d flow = -this->angularVelocity.cross(eta) + invDepth * etaVel;
-        estFlows.emplace_back(make_pair(eta, flow));
+        estFlows.emplace_back(make_pair(lm.sphereCoordinates, estimateFlow(lm)));
     }
 
     return estFlows;
 }
 
+Vector3d EgoMotion::estimateFlow(const GIFT::Landmark& landmark) const {
+    auto Proj3 = [](const Vector3d& vec) { return Matrix3d::Identity() - vec*vec.transpose()/vec.squaredNorm(); };
+
+    const Vector3d& eta = landmark.sphereCoordinates;
+    const Vector3d etaVel = Proj3(eta) * this->linearVelocity;
+
+    double invDepth = 0;
+    if (etaVel.norm() > 0) invDepth = -etaVel.dot(landmark.opticalFlowSphere + this->angularVelocity.cross(eta)) / etaVel.squaredNorm();
+
+    Vector3d flow = -this->angularVelocity.cross(eta) + invDepth * etaVel;
+    return flow;
+}
+
 Vector3d EgoMotion::estimateAngularVelocity(const vector<pair<Vector3d, Vector3d>>& sphereFlows, const Vector3d& linVel) {
     // Uses ordinary least squares to estimate angular velocity from linear velocity and flows.
     auto Proj3 = [](const Vector3d& vec) { return Matrix3d::Identity() - vec*vec.transpose()/vec.squaredNorm(); };
@@ -19,130 +19,481 @@
 #include "opencv2/video/tracking.hpp"
 #include "opencv2/stereo/stereo.hpp"
 #include "opencv2/core/eigen.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "eigen3/Eigen/SVD"
 #include "iostream"
 #include "string"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
 
 using namespace GIFT;
 
-void FeatureTracker::processImage(const Mat &image) {
-    this->trackLandmarks(image);
+void FeatureTracker::processImage(const Mat &image, const double& dt) {
+    const auto frameStart = chrono::steady_clock::now();
+    // This frame's landmarks are written into the buffer while the last ones are read from their snapshot.
+    const vector<Landmark>* previous = &currentLandmarks();
+    this->landmarks.clear();
+    if (this->landmarks.capacity() < this->maxFeatures) this->landmarks.reserve(this->maxFeatures);
+    currentStats.clear();
+    currentStats.frames = 1;
+
+    const bool historyChanged = history.length() != max(historyLength, 0);
+    if (historyChanged || previous->size() > this->maxFeatures) {
+        // The last landmarks have to change before tracking, so copy them and track them in place.
+        this->landmarks.assign(previous->begin(), previous->end());
+        previous = &this->landmarks;
+        if (historyChanged) resetHistory();
+
+        // The feature budget may have been cut. Landmarks are kept in order of age, so this drops the youngest.
+        if (this->landmarks.size() > this->maxFeatures) {
+            for (auto it = this->landmarks.begin() + this->maxFeatures; it != this->landmarks.end(); ++it) {
+                retireLandmark(*it);
+                ++currentStats.lostBudget;
+            }
+            this->landmarks.erase(this->landmarks.begin() + this->maxFeatures, this->landmarks.end());
+        }
+    }
+
+    if (decimateFrame(image, dt, previous->size())) {
+        // The previous image and pyramid stay those of the last tracked frame.
+        if (previous != &this->landmarks) this->landmarks.assign(previous->begin(), previous->end());
+        for (auto & lm : landmarks) {
+            lm.opticalFlowRaw.setZero();
+            lm.opticalFlowNorm.setZero();
+            lm.opticalFlowSphere.setZero();
+        }
+        predictionAvailable = false;
+        ++currentStats.decimatedFrames;
+        stageTimes = StageTimes();
+        stageTimes.total = chrono::duration<double>(chrono::steady_clock::now() - frameStart).count();
+        computeCoverage(image.size());
+        accumulatedStats.accumulate(currentStats);
+        this->publishSnapshot();
+        return;
+    }
+
+    // Track and detect on a downscaled image if asked. Landmarks stay in full resolution pixels.
+    frameScale = (processingScale > 0 && processingScale < 1) ? processingScale : 1.0;
+    if (frameScale != 1.0) {
+        cv::resize(image, scaledImage, Size(), frameScale, frameScale, INTER_AREA);
+        if (previousScale != frameScale && !previousImage.empty()) {
+            cv::resize(previousImage, previousScaledImage, scaledImage.size(), 0, 0, INTER_AREA);
+        }
+        if (!imageMask.empty() && scaledMask.size() != scaledImage.size()) {
+            cv::resize(imageMask, scaledMask, scaledImage.size(), 0, 0, INTER_NEAREST);
+        }
+    }
+    const Mat& processedImage = (frameScale != 1.0) ? scaledImage : image;
+    const Mat& previousProcessedImage = (frameScale != 1.0) ? previousScaledImage : previousImage;
+
+    // Only the part of the image covering the regions of interest is tracked and searched.
+    const Rect crop = croppedRegion(processedImage.size(), frameScale);
+    const Mat imageCrop = processedImage(crop);
+
+    // The builtin tracker needs the grey image before tracking; otherwise it is only needed for detection.
+    const bool builtinTracking = (trackingBackend == TrackingBackend::Builtin);
+    if (builtinTracking) {
+        const int levels = max(trackingPyramidLevels, predictedTrackingPyramidLevels);
+        const bool cropChanged = (crop != previousCrop) || (frameScale != previousScale);
+        if (cropChanged && previousProcessedImage.size() == processedImage.size()) {
+            // The previous pyramid was built over another crop or scale, so rebuild it over this one.
+            cv::cvtColor(previousProcessedImage(crop), previousImageGrey, cv::COLOR_BGR2GRAY);
+            lkTracker.setImage(previousImageGrey, levels);
+        }
+        cv::cvtColor(imageCrop, imageGrey, cv::COLOR_BGR2GRAY);
+        lkTracker.setImage(imageGrey, levels);
+    }
+
+    this->trackLandmarks(*previous, image, processedImage, crop);
     image.copyTo(this->previousImage);
+    previousCrop = crop;
+    const auto trackingEnd = chrono::steady_clock::now();
 
-    if (this->landmarks.size() > this->featureSearchThreshold*this->maxFeatures) return;
+    if (this->landmarks.size() <= this->featureSearchThreshold*this->maxFeatures) {
+        if (!builtinTracking) cv::cvtColor(imageCrop, imageGrey, cv::COLOR_BGR2GRAY);
+        this->detectNewFeatures(imageGrey, crop);
+        this->addNewLandmarks(image, this->proposedFeatures);
+    }
 
-    vector<Point2f> newFeatures = this->detectNewFeatures(image);
-    vector<Landmark> newLandmarks = this->createNewLandmarks(image, newFeatures);
+    // The scaled image becomes the previous one, and its old buffer is reused for the next frame.
+    if (frameScale != 1.0) std::swap(scaledImage, previousScaledImage);
+    previousScale = frameScale;
+    const auto detectionEnd = chrono::steady_clock::now();
+
+    stageTimes.tracking = chrono::duration<double>(trackingEnd - frameStart).count();
+    stageTimes.detection = chrono::duration<double>(detectionEnd - trackingEnd).count();
+    stageTimes.total = chrono::duration<double>(detectionEnd - frameStart).count();
+    if (budget) {
+        budget->update(stageTimes);
+        applyEffort(budget->trackingEffort(), budget->detectionEffort());
+    }
 
-    this->addNewLandmarks(newLandmarks);
+    computeCoverage(image.size());
+    accumulatedStats.accumulate(currentStats);
+    this->publishSnapshot();
 }
 
-vector<Landmark> FeatureTracker::createNewLandmarks(const Mat &image, const vector<Point2f>& newFeatures) {
-    vector<Landmark> newLandmarks;
-    if (newFeatures.empty()) return newLandmarks;
+bool FeatureTracker::decimateFrame(const Mat &image, const double& dt, size_t landmarkCount) {
+    pendingInterval += dt;
+    decimation.decimated = false;
+    decimation.imageChange = 0;
+
+    if (decimateStaticFrames) {
+        cv::resize(image, changeThumbnail, changeThumbnailSize, 0, 0, INTER_AREA);
+        if (changeThumbnail.channels() == 3) cv::cvtColor(changeThumbnail, currentThumbnail, cv::COLOR_BGR2GRAY);
+        else changeThumbnail.copyTo(currentThumbnail);
+
+        // Compare with the frame the landmarks were last tracked in, so that slow motion still adds up.
+        const bool comparable = !trackedThumbnail.empty() && trackedThumbnail.size() == currentThumbnail.size();
+        if (comparable) decimation.imageChange = cv::norm(currentThumbnail, trackedThumbnail, NORM_L1) / currentThumbnail.total();
+        decimation.decimated = comparable
+            && decimation.imageChange < staticChangeThreshold
+            && decimation.decimatedFrames < maxDecimatedFrames
+            && landmarkCount > featureSearchThreshold*maxFeatures;
+        if (!decimation.decimated) std::swap(currentThumbnail, trackedThumbnail);
+    }
 
-    vector<Point2f> newFeaturesNorm;
-    cv::undistortPoints(newFeatures, newFeaturesNorm, camera.K, camera.distortionParams);
+    decimation.flowInterval = pendingInterval;
+    if (decimation.decimated) {
+        ++decimation.decimatedFrames;
+    } else {
+        decimation.decimatedFrames = 0;
+        pendingInterval = 0;
+    }
+    return decimation.decimated;
+}
 
-    for (int i = 0; i < newFeatures.size(); ++i) {
-        
-        Point2f proposedFeature = newFeatures[i];
-        Point2f proposedFeatureNorm = newFeaturesNorm[i];
+void FeatureTracker::setTargetLatency(const double& targetLatency) {
+    // Start from the current settings, or from the full effort settings if a budget is already active.
+    if (budget) clearTargetLatency();
+    const TrackingEffort fullTracking = {maxFeatures, trackingPyramidLevels, trackingWindow};
+    const DetectionEffort fullDetection = {featureSearchThreshold, detectionCoverage};
+    budget.emplace(targetLatency, fullTracking, fullDetection);
+}
 
-        colorVec pointColor = {image.at<Vec3b>(newFeatures[i]).val[0],
-                               image.at<Vec3b>(newFeatures[i]).val[1],
-                               image.at<Vec3b>(newFeatures[i]).val[2]};
+void FeatureTracker::clearTargetLatency() {
+    if (!budget) return;
+    applyEffort(budget->trackingLadder.front(), budget->detectionLadder.front());
+    budget.reset();
+}
 
-        Landmark lm(proposedFeature, proposedFeatureNorm, -1, pointColor);
+void FeatureTracker::applyEffort(const TrackingEffort& tracking, const DetectionEffort& detection) {
+    maxFeatures = tracking.maxFeatures;
+    trackingPyramidLevels = tracking.pyramidLevels;
+    trackingWindow = tracking.window;
+    featureSearchThreshold = detection.featureSearchThreshold;
+    detectionCoverage = detection.coverage;
+}
 
-        newLandmarks.emplace_back(lm);
-    }
+void FeatureTracker::publishSnapshot() {
+    // The snapshot takes this frame's landmarks, and its stale ones become the buffer of the next frame.
+    // Recycled snapshots keep their capacity, so neither side allocates once warmed up.
+    shared_ptr<LandmarkSnapshot> snapshot = snapshots.acquire();
+    snapshot->frameNumber = ++frameNumber;
+    snapshot->landmarks.swap(landmarks);
+    snapshot->budgetDecision = budgetDecision();
+    snapshot->stats = currentStats;
+    snapshot->decimation = decimation;
+    snapshots.publish(snapshot);
+    currentSnapshot = snapshot;
+}
 
-    return newLandmarks;
+const vector<Landmark>& FeatureTracker::currentLandmarks() const {
+    static const vector<Landmark> noLandmarks;
+    return currentSnapshot ? currentSnapshot->landmarks : noLandmarks;
 }
 
-void FeatureTracker::trackLandmarks(const Mat &image) {
-    if (landmarks.empty()) return;
+void FeatureTracker::trackLandmarks(const vector<Landmark>& previous, const Mat &image, const Mat &processedImage, const Rect &crop) {
+    const bool usePrediction = predictionAvailable && (predictedPoints.size() == previous.size());
+    predictionAvailable = false;
+    if (previous.empty()) return;
 
-    vector<Point2f> oldPoints;
-    for (const auto & feature: landmarks) {
-        oldPoints.emplace_back(feature.camCoordinates);
+    // LK works in the coordinates of the cropped, and possibly scaled, images.
+    const Point2f offset(crop.x, crop.y);
+    oldPoints.clear();
+    for (const auto & feature: previous) {
+        oldPoints.emplace_back(toProcessed(feature.camCoordinates) - offset);
     }
 
-    vector<Point2f> points;
-    vector<uchar> status;
-    vector<float> err;
-    calcOpticalFlowPyrLK(previousImage, image, oldPoints, points, status, err);
+    // Start from the predicted positions if there are any, and search less when they can be trusted.
+    int flags = 0;
+    Size window = trackingWindow;
+    int pyramidLevels = trackingPyramidLevels;
+    if (usePrediction) {
+        trackedPoints.clear();
+        for (const auto & point : predictedPoints) trackedPoints.emplace_back(toProcessed(point) - offset);
+        flags = OPTFLOW_USE_INITIAL_FLOW;
+        if (predictionReliable) {
+            window = predictedTrackingWindow;
+            pyramidLevels = predictedTrackingPyramidLevels;
+        }
+    }
+    usedTrackingWindow = window;
+    usedTrackingPyramidLevels = pyramidLevels;
+
+    if (trackingBackend == TrackingBackend::Builtin) {
+        lkTracker.track(oldPoints, trackedPoints, trackedStatus, trackedError, window, pyramidLevels, usePrediction);
+    } else {
+        const Mat& previousProcessedImage = (frameScale != 1.0) ? previousScaledImage : previousImage;
+        calcOpticalFlowPyrLK(previousProcessedImage(crop), processedImage(crop), oldPoints, trackedPoints, trackedStatus, trackedError,
+                             window, pyramidLevels, TermCriteria(TermCriteria::COUNT+TermCriteria::EPS, 30, 0.01), flags);
+    }
+    for (auto & point : trackedPoints) point = toFull(point + offset);
+    if (refineAtFullResolution && frameScale != 1.0) refineTrackedPoints(previous, image);
+    cv::undistortPoints(trackedPoints, trackedPointsNorm, camera.K, camera.distortionParams);
 
-    vector<Point2f> pointsNorm;
-    cv::undistortPoints(points, pointsNorm, camera.K, camera.distortionParams);
+    // The fields to update are chosen once per frame, so the loop only computes the selected ones.
+    static constexpr auto updaters = landmarkUpdaters(std::make_index_sequence<LandmarkFields::All + 1>());
+    (this->*updaters[landmarkFields & LandmarkFields::All])(previous, image);
+}
+
+void FeatureTracker::refineTrackedPoints(const vector<Landmark>& previous, const Mat &image) {
+    // One LK level on the full resolution images, starting from the scaled result. Points that fail to
+    // refine keep their scaled result.
+    const Rect crop = croppedRegion(image.size(), 1.0);
+    const Point2f offset(crop.x, crop.y);
+
+    refinementPoints.clear();
+    refinedPoints.clear();
+    for (size_t i = 0; i < previous.size(); ++i) {
+        refinementPoints.emplace_back(previous[i].camCoordinates - offset);
+        refinedPoints.emplace_back(trackedPoints[i] - offset);
+    }
+    calcOpticalFlowPyrLK(previousImage(crop), image(crop), refinementPoints, refinedPoints, refinedStatus, refinedError,
+                         refinementWindow, 0, TermCriteria(TermCriteria::COUNT+TermCriteria::EPS, 10, 0.01), OPTFLOW_USE_INITIAL_FLOW);
+    for (size_t i = 0; i < trackedPoints.size(); ++i) {
+        if (trackedStatus[i] == 0 || refinedStatus[i] == 0) continue;
+        trackedPoints[i] = refinedPoints[i] + offset;
+        trackedError[i] = refinedError[i];
+    }
+}
 
-    for (long int i=points.size()-1; i >= 0; --i) {
-        if (status[i] == 0) {
-            landmarks.erase(landmarks.begin() + i);
+template<unsigned Fields>
+void FeatureTracker::updateTrackedLandmarks(const vector<Landmark>& previous, const Mat &image) {
+    // Write the surviving landmarks into this frame's buffer and update them there, preserving their order.
+    // If the buffer already holds the last landmarks, they are compacted in place instead.
+    const bool inPlace = (&previous == &landmarks);
+    size_t keptCount = 0;
+    for (size_t i = 0; i < trackedPoints.size(); ++i) {
+        if (trackedStatus[i] == 0) {
+            retireLandmark(previous[i]);
+            ++currentStats.lostTracking;
+            continue;
+        }
+        const bool masked = !imageMask.empty() && imageMask.at<uchar>(trackedPoints[i]) == 0;
+        if (masked || !insideRegionsOfInterest(trackedPoints[i])) {
+            retireLandmark(previous[i]);
+            ++currentStats.lostMask;
             continue;
         }
 
-        if (!imageMask.empty()) {
-            if (imageMask.at<uchar>(points[i])==0) {
-                landmarks.erase(landmarks.begin() + i);
-                continue;
-            } 
+        colorVec pointColor = {0,0,0};
+        if constexpr ((Fields & LandmarkFields::Color) != 0) {
+            const Vec3b& pixel = image.at<Vec3b>(trackedPoints[i]);
+            pointColor = {pixel.val[0], pixel.val[1], pixel.val[2]};
         }
+        if (!inPlace) landmarks.emplace_back(previous[i]);
+        else if (keptCount != i) landmarks[keptCount] = landmarks[i];
+        Landmark& lm = landmarks[keptCount];
+        lm.update<Fields>(trackedPoints[i], trackedPointsNorm[i], pointColor);
+        lm.trackingError = trackedError[i];
+        if (lm.historySlot >= 0) history.push(lm.historySlot, lm.camCoordinates, lm.sphereCoordinates);
+        currentStats.trackingErrorSum += trackedError[i];
+        ++currentStats.trackedCount;
+        ++keptCount;
+    }
+    landmarks.erase(landmarks.begin() + keptCount, landmarks.end());
+}
 
-        colorVec pointColor = {image.at<Vec3b>(points[i]).val[0],
-                                image.at<Vec3b>(points[i]).val[1],
-                                image.at<Vec3b>(points[i]).val[2]};
-        landmarks[i].update(points[i], pointsNorm[i], pointColor);
-        
+void FeatureTracker::predictFromEgoMotion(const EgoMotion& egoMotion, const double& dt) {
+    predictedBearings.clear();
+    for (const auto & lm : currentLandmarks()) {
+        const Vector3d eta = (lm.sphereCoordinates + dt*egoMotion.estimateFlow(lm)).normalized();
+        predictedBearings.emplace_back(eta.x(), eta.y(), eta.z());
     }
+    projectPredictedBearings(egoMotion.optimisedResidual < predictionResidualThreshold);
+}
+
+void FeatureTracker::predictFromAngularVelocity(const Vector3d& angularVelocity, const double& dt, bool reliable) {
+    // A measured rotation rate predicts the rotational part of the flow, which dominates under fast rotation.
+    // Translation is not predicted, so unless the caller knows it is small the full search is kept.
+    predictedBearings.clear();
+    for (const auto & lm : currentLandmarks()) {
+        const Vector3d& eta = lm.sphereCoordinates;
+        const Vector3d predictedEta = (eta - dt*angularVelocity.cross(eta)).normalized();
+        predictedBearings.emplace_back(predictedEta.x(), predictedEta.y(), predictedEta.z());
+    }
+    projectPredictedBearings(reliable);
+}
+
+void FeatureTracker::projectPredictedBearings(bool reliable) {
+    // Bearings that move behind the camera cannot be projected, so keep those at their current position.
+    for (size_t i = 0; i < predictedBearings.size(); ++i) {
+        if (predictedBearings[i].z < 1e-3) {
+            const Vector3d& eta = currentLandmarks()[i].sphereCoordinates;
+            predictedBearings[i] = Point3f(eta.x(), eta.y(), eta.z());
+        }
+    }
+
+    if (predictedBearings.empty()) {
+        predictionAvailable = false;
+        return;
+    }
+    const Vec3d noMotion(0,0,0);
+    cv::projectPoints(predictedBearings, noMotion, noMotion, camera.K, camera.distortionParams, predictedPoints);
+    predictionAvailable = true;
+    predictionReliable = reliable;
 }
 
 void FeatureTracker::setCameraConfiguration(const CameraParameters &configuration) {
     camera = configuration;
 }
 
-vector<Point2f> FeatureTracker::detectNewFeatures(const Mat &image) const {
-    Mat imageGrey;
-    cv::cvtColor(image, imageGrey, cv::COLOR_BGR2GRAY);
-
-    vector<Point2f> proposedFeatures;
-    goodFeaturesToTrack(imageGrey, proposedFeatures, maxFeatures, minHarrisQuality, featureDist, imageMask);
-    vector<Point2f> newFeatures = this->removeDuplicateFeatures(proposedFeatures);
+void FeatureTracker::detectNewFeatures(const Mat &imageGrey, const Rect &crop) {
+    // The grey image covers the crop. Search each region of interest, or the whole crop if there are none.
+    searchRegions.clear();
+    if (regionsOfInterest.empty()) {
+        searchRegions.emplace_back(0, 0, imageGrey.cols, imageGrey.rows);
+    } else {
+        for (const Rect& region : regionsOfInterest) {
+            const Rect searched = (scaleRegion(region, frameScale) & crop) - crop.tl();
+            if (searched.area() > 0) searchRegions.emplace_back(searched);
+        }
+    }
+    double searchArea = 0;
+    for (const Rect& region : searchRegions) searchArea += region.area();
+
+    // Below full coverage, only search a run of horizontal bands of the crop.
+    const int bandCount = (detectionCoverage >= 1.0) ? 1 : max(detectionBands, 1);
+    const int searchedBands = min(max((int)ceil(detectionCoverage*bandCount), 1), bandCount);
+
+    // Each searched rectangle gets its share of the features by area, and at least one. Detectors differ in how
+    // they treat a budget of zero, and the product of the budget and a large area overflows an int.
+    const Mat& mask = (frameScale != 1.0) ? scaledMask : imageMask;
+    proposedFeatures.clear();
+    for (int i = 0; i < searchedBands; ++i) {
+        const int band = (nextDetectionBand + i) % bandCount;
+        const int top = band * imageGrey.rows / bandCount;
+        const int bottom = (band + 1) * imageGrey.rows / bandCount;
+        const Rect bandRegion(0, top, imageGrey.cols, bottom - top);
+        for (const Rect& searchRegion : searchRegions) {
+            const Rect region = searchRegion & bandRegion;
+            if (region.area() == 0) continue;
+            const int quota = max((int)ceil(maxFeatures * (double)region.area() / searchArea), 1);
+            const Rect imageRegion = region + crop.tl();
+            detectCorners(imageGrey(region), mask.empty() ? mask : mask(imageRegion), quota, featureDist*frameScale, bandFeatures);
+            for (const auto & feature : bandFeatures) proposedFeatures.emplace_back(toFull(Point2f(feature.x + imageRegion.x, feature.y + imageRegion.y)));
+        }
+    }
+    nextDetectionBand = (nextDetectionBand + searchedBands) % bandCount;
+    const int candidateCount = proposedFeatures.size();
+    this->removeDuplicateFeatures(proposedFeatures);
+    currentStats.candidates += candidateCount;
+    currentStats.rejectedDuplicate += candidateCount - (int)proposedFeatures.size();
+}
 
-    return newFeatures;
+void FeatureTracker::detectCorners(const Mat &imageGrey, const Mat &mask, int maxCorners, double minDistance, vector<Point2f> &corners) {
+    if (cornerDetector) {
+        cornerDetector->detect(imageGrey, mask, maxCorners, minDistance, corners);
+    } else {
+        goodFeaturesToTrack(imageGrey, corners, maxCorners, minHarrisQuality, minDistance, mask);
+    }
 }
 
-vector<Point2f> FeatureTracker::removeDuplicateFeatures(const vector<Point2f> &proposedFeatures) const {
-    vector<Point2f> newFeatures;
-    for (const auto & proposedFeature : proposedFeatures) {
-        bool useFlag = true;
+void FeatureTracker::removeDuplicateFeatures(vector<Point2f> &features) const {
+    auto isDuplicate = [this](const Point2f& proposedFeature) {
         for (const auto & feature : this->landmarks) {
-            if (norm(proposedFeature - feature.camCoordinates) < featureDist) {
-                useFlag = false;
-                break;
-            }
+            if (norm(proposedFeature - feature.camCoordinates) < featureDist) return true;
         }
+        return false;
+    };
+    features.erase(remove_if(features.begin(), features.end(), isDuplicate), features.end());
+}
 
-        if (useFlag) {
-            newFeatures.emplace_back(proposedFeature);
+void FeatureTracker::addNewLandmarks(const Mat &image, const vector<Point2f>& newFeatures) {
+    if (newFeatures.empty()) return;
+
+    cv::undistortPoints(newFeatures, newFeaturesNorm, camera.K, camera.distortionParams);
+
+    for (size_t i = 0; i < newFeatures.size(); ++i) {
+        if (landmarks.size() >= maxFeatures) {
+            currentStats.rejectedCap += newFeatures.size() - i;
+            break;
+        }
+
+        colorVec pointColor = {0,0,0};
+        if (landmarkFields & LandmarkFields::Color) {
+            const Vec3b& pixel = image.at<Vec3b>(newFeatures[i]);
+            pointColor = {pixel.val[0], pixel.val[1], pixel.val[2]};
         }
+        landmarks.emplace_back(newFeatures[i], newFeaturesNorm[i], ++currentNumber, pointColor);
+        Landmark& lm = landmarks.back();
+        lm.historySlot = history.allocate();
+        if (lm.historySlot >= 0) history.push(lm.historySlot, lm.camCoordinates, lm.sphereCoordinates);
+        ++currentStats.births;
     }
-    return newFeatures;
 }
 
-void FeatureTracker::addNewLandmarks(vector<Landmark> newLandmarks) {
-    for (auto & lm : newLandmarks) {
-        if (landmarks.size() >= maxFeatures) break;
+void FeatureTracker::retireLandmark(const Landmark& landmark) {
+    currentStats.recordDeath(landmark.lifetime);
+    history.release(landmark.historySlot);
+}
+
+void FeatureTracker::resetHistory() {
+    // The landmarks alive now start new histories from their current positions.
+    history.reset(historyLength, maxFeatures);
+    for (auto & lm : landmarks) {
+        lm.historySlot = history.allocate();
+        if (lm.historySlot >= 0) history.push(lm.historySlot, lm.camCoordinates, lm.sphereCoordinates);
+    }
+}
 
-        lm.idNumber = ++currentNumber;
-        landmarks.emplace_back(lm);
+void FeatureTracker::computeCoverage(const Size& imageSize) {
+    const int rows = max(coverageGrid.height, 1);
+    const int cols = max(coverageGrid.width, 1);
+    currentStats.coverageRows = rows;
+    currentStats.coverageCols = cols;
+    currentStats.coverage.assign(rows*cols, 0);
+    if (imageSize.area() == 0) return;
+
+    for (const auto & lm : landmarks) {
+        const int row = min(max((int)(lm.camCoordinates.y * rows / imageSize.height), 0), rows - 1);
+        const int col = min(max((int)(lm.camCoordinates.x * cols / imageSize.width), 0), cols - 1);
+        ++currentStats.coverage[row*cols + col];
     }
 }
 
 void FeatureTracker::setMask(const Mat & mask, int cameraNumber) {
     imageMask = mask;
+    scaledMask.release();
+}
+
+Rect FeatureTracker::scaleRegion(const Rect& region, double scale) {
+    if (scale == 1.0) return region;
+    const int left = (int)floor(region.x * scale);
+    const int top = (int)floor(region.y * scale);
+    const int right = (int)ceil((region.x + region.width) * scale);
+    const int bottom = (int)ceil((region.y + region.height) * scale);
+    return Rect(left, top, right - left, bottom - top);
+}
+
+Rect FeatureTracker::croppedRegion(const Size& imageSize, double scale) const {
+    const Rect image(Point(0,0), imageSize);
+    if (regionsOfInterest.empty()) return image;
+    Rect bounds;
+    for (const Rect& region : regionsOfInterest) bounds |= (scaleRegion(region, scale) & image);
+    // With no region inside the image there is nothing to track, but keep the image to stay valid.
+    return (bounds.area() > 0) ? bounds : image;
+}
+
+bool FeatureTracker::insideRegionsOfInterest(const Point2f& point) const {
+    if (regionsOfInterest.empty()) return true;
+    for (const Rect& region : regionsOfInterest) {
+        if (point.x >= region.x && point.y >= region.y && point.x < region.x + region.width && point.y < region.y + region.height) return true;
+    }
+    return false;
 }
 
 
@@ -158,7 +509,7 @@ Eigen::Matrix3d GIFT::skew_matrix(const Eigen::Vector3d& t){
 Mat FeatureTracker::drawFeatureImage(const Scalar& color, const int pointSize, const int thickness) const {
         cv::Mat featureImage;
         this->previousImage.copyTo(featureImage);
-        for (const auto &lm : this->landmarks) {
+        for (const auto &lm : this->currentLandmarks()) {
             cv::circle(featureImage, lm.camCoordinates, pointSize, color, thickness);
         }
         return featureImage;
@@ -166,7 +517,7 @@ Mat FeatureTracker::drawFeatureImage(const Scalar& color, const int pointSize, c
 
 Mat FeatureTracker::drawFlowImage(const Scalar& featureColor, const Scalar& flowColor, const int pointSize, const int thickness) const {
     Mat flowImage = drawFeatureImage(featureColor, pointSize, thickness);
-    for (const auto &lm : this->landmarks) {
+    for (const auto &lm : this->currentLandmarks()) {
             Point2f p1 = lm.camCoordinates;
             Point2f p0 =  p1 - Point2f(lm.opticalFlowRaw.x(), lm.opticalFlowRaw.y());
             line(flowImage, p0, p1, flowColor, thickness);
@@ -178,7 +529,7 @@ Mat FeatureTracker::drawFlow(const Scalar& featureColor, const Scalar& flowColor
     Mat flow(this->previousImage.size(), CV_8UC3);
     flow.setTo(0);
     
-    for (const auto &lm : this->landmarks) {
+    for (const auto &lm : this->currentLandmarks()) {
             Point2f p1 = lm.camCoordinates;
             Point2f p0 =  p1 - Point2f(lm.opticalFlowRaw.x(), lm.opticalFlowRaw.y());
             circle(flow, p1, pointSize, featureColor, thickness);
@@ -0,0 +1,105 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FlowCoreset.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace GIFT;
+using namespace std;
+using namespace Eigen;
+
+int FlowCoreset::binOf(const Vector3d& bearing) const {
+    // The face is given by the largest component, and the other two give the position on that face.
+    int axis;
+    bearing.cwiseAbs().maxCoeff(&axis);
+    const double major = bearing(axis);
+    const int face = 2*axis + (major < 0 ? 1 : 0);
+    const double u = bearing((axis + 1) % 3) / fabs(major);
+    const double v = bearing((axis + 2) % 3) / fabs(major);
+
+    // Equal angles rather than equal distances on the face give bins of nearly equal area on the sphere.
+    const int n = max(binsPerFaceSide, 1);
+    auto cell = [n](double t) { return min(max((int)((atan(t) * (4.0 / M_PI) + 1.0) * 0.5 * n), 0), n - 1); };
+    return (face*n + cell(v))*n + cell(u);
+}
+
+const vector<pair<Vector3d, Vector3d>>& FlowCoreset::select(const vector<Landmark>& landmarks, int minLifetime, const double& dt) {
+    candidates.clear();
+    for (size_t i = 0; i < landmarks.size(); ++i) {
+        const Landmark& lm = landmarks[i];
+        if (lm.lifetime < minLifetime || lm.lifetime < 1) continue;
+        const double score = lifetimeWeight*log((double)lm.lifetime) - errorWeight*lm.trackingError;
+        candidates.push_back({binOf(lm.sphereCoordinates), score, (int)i});
+    }
+    selectCandidates();
+
+    selectedFlows.clear();
+    for (int index : selected) {
+        selectedFlows.emplace_back(landmarks[index].sphereCoordinates, landmarks[index].opticalFlowSphere / dt);
+    }
+    return selectedFlows;
+}
+
+const vector<pair<Vector3d, Vector3d>>& FlowCoreset::select(const vector<pair<Vector3d, Vector3d>>& flows) {
+    candidates.clear();
+    for (size_t i = 0; i < flows.size(); ++i) {
+        candidates.push_back({binOf(flows[i].first), 0.0, (int)i});
+    }
+    selectCandidates();
+
+    selectedFlows.clear();
+    for (int index : selected) selectedFlows.emplace_back(flows[index]);
+    return selectedFlows;
+}
+
+void FlowCoreset::selectCandidates() {
+    selected.clear();
+    if (candidates.empty() || maxFlows <= 0) return;
+
+    // Group the candidates by bin, best first within each bin.
+    sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return (a.bin != b.bin) ? (a.bin < b.bin) : (a.score > b.score);
+    });
+    binHeads.clear();
+    binEnds.clear();
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        if (i == 0 || candidates[i].bin != candidates[i-1].bin) {
+            binHeads.emplace_back(i);
+            if (i > 0) binEnds.emplace_back(i);
+        }
+    }
+    binEnds.emplace_back(candidates.size());
+
+    // Every bin with candidates left gives its best in each round. When a round does not fit,
+    // its best candidates are taken, so no bin is favoured for coming first.
+    while ((int)selected.size() < maxFlows) {
+        roundCandidates.clear();
+        for (size_t b = 0; b < binHeads.size(); ++b) {
+            if (binHeads[b] < binEnds[b]) roundCandidates.emplace_back(binHeads[b]++);
+        }
+        if (roundCandidates.empty()) break;
+
+        const size_t room = maxFlows - selected.size();
+        if (roundCandidates.size() > room) {
+            nth_element(roundCandidates.begin(), roundCandidates.begin() + room, roundCandidates.end(),
+                        [this](int a, int b) { return candidates[a].score > candidates[b].score; });
+            roundCandidates.resize(room);
+        }
+        for (int c : roundCandidates) selected.emplace_back(candidates[c].index);
+    }
+}
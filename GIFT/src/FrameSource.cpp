@@ -0,0 +1,186 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "FrameSource.h"
+#include "opencv2/imgcodecs/imgcodecs.hpp"
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+using namespace GIFT;
+using namespace std;
+using namespace cv;
+
+static void backOff(int& attempt) {
+    if (++attempt < 64) this_thread::yield();
+    else this_thread::sleep_for(chrono::microseconds(100));
+}
+
+VideoFrameSource::VideoFrameSource(const String& videoFile) {
+    if (!capture.open(videoFile)) throw invalid_argument("Could not open the video " + videoFile + ".");
+}
+
+VideoFrameSource::VideoFrameSource(int cameraDevice) {
+    if (!capture.open(cameraDevice)) throw invalid_argument("Could not open the camera device " + to_string(cameraDevice) + ".");
+    live = true;
+}
+
+ImageDirectoryFrameSource::ImageDirectoryFrameSource(const String& pattern) {
+    cv::glob(pattern, fileNames, false);
+    if (fileNames.empty()) throw invalid_argument("No images match " + pattern + ".");
+}
+
+bool ImageDirectoryFrameSource::read(Mat& image) {
+    if (nextFile >= fileNames.size()) return false;
+
+    // Read the encoded file into a reused buffer and decode into the caller's image,
+    // so neither buffer is reallocated for a sequence of same-sized images.
+    FILE* file = fopen(fileNames[nextFile].c_str(), "rb");
+    if (!file) throw runtime_error("Could not open the image " + fileNames[nextFile] + ".");
+    fseek(file, 0, SEEK_END);
+    long fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    fileBuffer.resize(fileSize);
+    size_t bytesRead = fread(fileBuffer.data(), 1, fileSize, file);
+    fclose(file);
+
+    ++nextFile;
+    if (bytesRead != (size_t)fileSize) return false;
+    imdecode(fileBuffer, IMREAD_COLOR, &image);
+    return !image.empty();
+}
+
+RawReplayFrameSource::RawReplayFrameSource(const string& fileName) {
+    file = fopen(fileName.c_str(), "rb");
+    if (!file) throw invalid_argument("Could not open the replay file " + fileName + ".");
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, rawReplayMagic, sizeof(header.magic)) != 0) {
+        fclose(file);
+        throw invalid_argument("The file " + fileName + " is not a raw replay file.");
+    }
+}
+
+RawReplayFrameSource::~RawReplayFrameSource() {
+    fclose(file);
+}
+
+bool RawReplayFrameSource::read(Mat& image) {
+    image.create(header.height, header.width, header.type);
+    const size_t rowBytes = image.cols * image.elemSize();
+    if (image.isContinuous()) {
+        return fread(image.data, rowBytes*image.rows, 1, file) == 1;
+    }
+    for (int row = 0; row < image.rows; ++row) {
+        if (fread(image.ptr(row), rowBytes, 1, file) != 1) return false;
+    }
+    return true;
+}
+
+RawReplayWriter::RawReplayWriter(const string& fileName) {
+    file = fopen(fileName.c_str(), "wb");
+    if (!file) throw invalid_argument("Could not open the replay file " + fileName + " for writing.");
+}
+
+RawReplayWriter::~RawReplayWriter() {
+    fclose(file);
+}
+
+void RawReplayWriter::write(const Mat& image) {
+    if (!headerWritten) {
+        memcpy(header.magic, rawReplayMagic, sizeof(header.magic));
+        header.width = image.cols;
+        header.height = image.rows;
+        header.type = image.type();
+        header.reserved = 0;
+        fwrite(&header, sizeof(header), 1, file);
+        headerWritten = true;
+    }
+    if (image.cols != header.width || image.rows != header.height || image.type() != header.type) {
+        throw invalid_argument("All frames of a raw replay file must have the same size and type.");
+    }
+
+    const size_t rowBytes = image.cols * image.elemSize();
+    for (int row = 0; row < image.rows; ++row) {
+        fwrite(image.ptr(row), rowBytes, 1, file);
+    }
+}
+
+PrefetchingFrameSource::PrefetchingFrameSource(unique_ptr<FrameSource> source, int bufferCount, FrameDropPolicy dropPolicy) {
+    // One slot is always kept free for the reader, so at least three are needed to prefetch ahead.
+    if (bufferCount < 3) throw invalid_argument("The prefetching ring needs at least three buffers.");
+    this->source = move(source);
+    this->dropPolicy = dropPolicy;
+    if (dropPolicy == FrameDropPolicy::Automatic) {
+        this->dropPolicy = this->source->isLive() ? FrameDropPolicy::DropOldest : FrameDropPolicy::Block;
+    }
+    this->buffers.resize(bufferCount);
+    decodeThread = thread(&PrefetchingFrameSource::decodeLoop, this);
+}
+
+PrefetchingFrameSource::~PrefetchingFrameSource() {
+    stopping.store(true);
+    decodeThread.join();
+}
+
+void PrefetchingFrameSource::decodeLoop() {
+    const uint64_t capacity = buffers.size() - 1;
+    while (!stopping.load()) {
+        const uint64_t h = head.load();
+
+        // Wait for space, or make it by discarding the oldest unread frame.
+        int attempt = 0;
+        while (h - tail.load() >= capacity) {
+            if (stopping.load()) return;
+            if (dropPolicy == FrameDropPolicy::DropOldest) {
+                uint64_t t = tail.load();
+                if (h - t >= capacity && tail.compare_exchange_strong(t, t+1)) dropped.fetch_add(1);
+            } else {
+                backOff(attempt);
+            }
+        }
+
+        // A drop can free the slot the reader is still swapping out; wait for it to finish.
+        const int slot = h % buffers.size();
+        attempt = 0;
+        while (readerSlot.load() == slot) backOff(attempt);
+
+        if (!source->read(buffers[slot])) break;
+        head.store(h+1);
+    }
+    finished.store(true);
+}
+
+bool PrefetchingFrameSource::read(Mat& image) {
+    int attempt = 0;
+    while (true) {
+        uint64_t t = tail.load();
+        if (t == head.load()) {
+            if (finished.load() && t == head.load()) return false;
+            backOff(attempt);
+            continue;
+        }
+
+        const int slot = t % buffers.size();
+        readerSlot.store(slot);
+        if (tail.compare_exchange_strong(t, t+1)) {
+            cv::swap(image, buffers[slot]);
+            readerSlot.store(-1);
+            return true;
+        }
+        // The decoder dropped this frame first, so try the next one.
+        readerSlot.store(-1);
+    }
+}
@@ -39,21 +39,3 @@ Landmark::Landmark(const Point2f& newCamCoords, const Point2f& newCamCoordsNorm,
 
     lifetime = 1;
 }
-
-void Landmark::update(const cv::Point2f& newCamCoords, const cv::Point2f& newCamCoordsNorm, const colorVec& col) {
-    this->opticalFlowRaw << newCamCoords.x - this->camCoordinates.x, newCamCoords.y - this->camCoordinates.y;
-    this->opticalFlowNorm << newCamCoordsNorm.x - this->camCoordinatesNorm.x, newCamCoordsNorm.y - this->camCoordinatesNorm.y;
-
-    this->camCoordinates = newCamCoords;
-    this->camCoordinatesNorm = newCamCoordsNorm;
-
-    Vector3d bearing = Vector3d(newCamCoordsNorm.x, newCamCoordsNorm.y, 1).normalized();
-
-    this->sphereCoordinates = bearing;
-    this->opticalFlowSphere = bearing.z() * (Matrix3d::Identity() - bearing*bearing.transpose()) * Vector3d(opticalFlowNorm.x(), opticalFlowNorm.y(), 0);
-
-    this->keypoint.pt = this->camCoordinates;
-
-    this->pointColor = col;
-    ++lifetime;
-}
\ No newline at end of file
@@ -0,0 +1,367 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "PyramidalLK.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+using namespace GIFT;
+using namespace std;
+using namespace cv;
+
+namespace {
+
+// Interpolation weights have 14 fractional bits. Interpolated intensities keep 5 of them,
+// so patches hold 32 times the pixel value, and gradients are scaled to match.
+constexpr int lkWeightBits = 14;
+constexpr int lkDescaleBits = lkWeightBits - 5;
+constexpr float lkMatrixScale = 1.f / (1 << 20);
+
+struct LKImageView {
+    const uchar* origin; // Pixel (0,0) of the level; the reflected border surrounds it
+    ptrdiff_t stride;
+    int width;
+    int height;
+};
+
+struct BilinearWeights {
+    int w00, w01, w10, w11;
+};
+
+BilinearWeights bilinearWeights(float a, float b) {
+    BilinearWeights w;
+    w.w00 = (int)lrintf((1.f - a) * (1.f - b) * (1 << lkWeightBits));
+    w.w01 = (int)lrintf(a * (1.f - b) * (1 << lkWeightBits));
+    w.w10 = (int)lrintf((1.f - a) * b * (1 << lkWeightBits));
+    w.w11 = (1 << lkWeightBits) - w.w00 - w.w01 - w.w10;
+    return w;
+}
+
+inline int16_t interpolatePixel(const uchar* p, ptrdiff_t stride, const BilinearWeights& w) {
+    const int value = p[0]*w.w00 + p[1]*w.w01 + p[stride]*w.w10 + p[stride+1]*w.w11;
+    return (int16_t)((value + (1 << (lkDescaleBits-1))) >> lkDescaleBits);
+}
+
+// Rows of the window are stored with a padded stride so the vector loops never need a tail.
+// Padding entries of the template and its gradients are zero, so they add nothing to the sums.
+template<int W> struct LKWindow {
+    static constexpr int half = W / 2;
+    static constexpr int stride = (W + 15) & ~15;
+};
+
+// Computes the mismatch vector b = sum((J - I) * [Ix, Iy]) for the window of J at (x,y).
+template<int W>
+void mismatchVector(const uchar* J, ptrdiff_t stride, const BilinearWeights& w,
+                    const int16_t* I, const int16_t* Ix, const int16_t* Iy, float& b1, float& b2) {
+    constexpr int S = LKWindow<W>::stride;
+#if defined(__AVX2__)
+    const __m256i w0001 = _mm256_set1_epi32((w.w01 << 16) | (w.w00 & 0xffff));
+    const __m256i w1011 = _mm256_set1_epi32((w.w11 << 16) | (w.w10 & 0xffff));
+    const __m256i rounding = _mm256_set1_epi32(1 << (lkDescaleBits-1));
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+
+    for (int y = 0; y < W; ++y, J += stride, I += S, Ix += S, Iy += S) {
+        __m256i rowSum1 = _mm256_setzero_si256();
+        __m256i rowSum2 = _mm256_setzero_si256();
+        for (int x = 0; x < S; x += 16) {
+            const __m256i p00 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(J + x)));
+            const __m256i p01 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(J + x + 1)));
+            const __m256i p10 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(J + x + stride)));
+            const __m256i p11 = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(J + x + stride + 1)));
+
+            // unpack/pack work within 128-bit lanes, so packing lo and hi restores the pixel order.
+            __m256i lo = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(p00, p01), w0001),
+                                          _mm256_madd_epi16(_mm256_unpacklo_epi16(p10, p11), w1011));
+            __m256i hi = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(p00, p01), w0001),
+                                          _mm256_madd_epi16(_mm256_unpackhi_epi16(p10, p11), w1011));
+            lo = _mm256_srai_epi32(_mm256_add_epi32(lo, rounding), lkDescaleBits);
+            hi = _mm256_srai_epi32(_mm256_add_epi32(hi, rounding), lkDescaleBits);
+            const __m256i jValues = _mm256_packs_epi32(lo, hi);
+
+            const __m256i diff = _mm256_sub_epi16(jValues, _mm256_load_si256((const __m256i*)(I + x)));
+            rowSum1 = _mm256_add_epi32(rowSum1, _mm256_madd_epi16(diff, _mm256_load_si256((const __m256i*)(Ix + x))));
+            rowSum2 = _mm256_add_epi32(rowSum2, _mm256_madd_epi16(diff, _mm256_load_si256((const __m256i*)(Iy + x))));
+        }
+        // Convert per row so the integer sums cannot overflow for large windows.
+        acc1 = _mm256_add_ps(acc1, _mm256_cvtepi32_ps(rowSum1));
+        acc2 = _mm256_add_ps(acc2, _mm256_cvtepi32_ps(rowSum2));
+    }
+
+    alignas(32) float sums1[8], sums2[8];
+    _mm256_store_ps(sums1, acc1);
+    _mm256_store_ps(sums2, acc2);
+    b1 = 0; b2 = 0;
+    for (int i = 0; i < 8; ++i) {
+        b1 += sums1[i];
+        b2 += sums2[i];
+    }
+#elif defined(__ARM_NEON)
+    float32x4_t acc1 = vdupq_n_f32(0.f);
+    float32x4_t acc2 = vdupq_n_f32(0.f);
+
+    for (int y = 0; y < W; ++y, J += stride, I += S, Ix += S, Iy += S) {
+        int32x4_t rowSum1 = vdupq_n_s32(0);
+        int32x4_t rowSum2 = vdupq_n_s32(0);
+        for (int x = 0; x < S; x += 8) {
+            const int16x8_t p00 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(J + x)));
+            const int16x8_t p01 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(J + x + 1)));
+            const int16x8_t p10 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(J + x + stride)));
+            const int16x8_t p11 = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(J + x + stride + 1)));
+
+            int32x4_t lo = vmull_n_s16(vget_low_s16(p00), w.w00);
+            lo = vmlal_n_s16(lo, vget_low_s16(p01), w.w01);
+            lo = vmlal_n_s16(lo, vget_low_s16(p10), w.w10);
+            lo = vmlal_n_s16(lo, vget_low_s16(p11), w.w11);
+            int32x4_t hi = vmull_n_s16(vget_high_s16(p00), w.w00);
+            hi = vmlal_n_s16(hi, vget_high_s16(p01), w.w01);
+            hi = vmlal_n_s16(hi, vget_high_s16(p10), w.w10);
+            hi = vmlal_n_s16(hi, vget_high_s16(p11), w.w11);
+            const int16x8_t jValues = vcombine_s16(vqrshrn_n_s32(lo, lkDescaleBits), vqrshrn_n_s32(hi, lkDescaleBits));
+
+            const int16x8_t diff = vsubq_s16(jValues, vld1q_s16(I + x));
+            const int16x8_t gradX = vld1q_s16(Ix + x);
+            const int16x8_t gradY = vld1q_s16(Iy + x);
+            rowSum1 = vmlal_s16(rowSum1, vget_low_s16(diff), vget_low_s16(gradX));
+            rowSum1 = vmlal_s16(rowSum1, vget_high_s16(diff), vget_high_s16(gradX));
+            rowSum2 = vmlal_s16(rowSum2, vget_low_s16(diff), vget_low_s16(gradY));
+            rowSum2 = vmlal_s16(rowSum2, vget_high_s16(diff), vget_high_s16(gradY));
+        }
+        acc1 = vaddq_f32(acc1, vcvtq_f32_s32(rowSum1));
+        acc2 = vaddq_f32(acc2, vcvtq_f32_s32(rowSum2));
+    }
+
+    b1 = vgetq_lane_f32(acc1, 0) + vgetq_lane_f32(acc1, 1) + vgetq_lane_f32(acc1, 2) + vgetq_lane_f32(acc1, 3);
+    b2 = vgetq_lane_f32(acc2, 0) + vgetq_lane_f32(acc2, 1) + vgetq_lane_f32(acc2, 2) + vgetq_lane_f32(acc2, 3);
+#else
+    b1 = 0; b2 = 0;
+    for (int y = 0; y < W; ++y, J += stride, I += S, Ix += S, Iy += S) {
+        int rowSum1 = 0, rowSum2 = 0;
+        for (int x = 0; x < W; ++x) {
+            const int diff = interpolatePixel(J + x, stride, w) - I[x];
+            rowSum1 += diff * Ix[x];
+            rowSum2 += diff * Iy[x];
+        }
+        b1 += rowSum1;
+        b2 += rowSum2;
+    }
+#endif
+}
+
+// Checks that a window with its top left corner at (x,y) stays inside the padded level,
+// including the one pixel margin and the S+1 columns read by the vector loops.
+template<int W>
+bool windowInside(const LKImageView& view, int x, int y) {
+    constexpr int S = LKWindow<W>::stride;
+    constexpr int border = PyramidalLK::pyramidBorder;
+    return x - 1 >= -border && y - 1 >= -border
+        && x + max(S, W + 1) + 1 < view.width + border && y + W + 1 < view.height + border;
+}
+
+// Tracks one point on one pyramid level. Returns false if the point cannot be tracked on this level.
+template<int W>
+bool trackPointOnLevel(const LKImageView& I, const LKImageView& J, const Point2f& prevPt, Point2f& nextPt,
+                       int maxIterations, float epsilon, float minEigThreshold, float* error) {
+    constexpr int half = LKWindow<W>::half;
+    constexpr int S = LKWindow<W>::stride;
+
+    const Point2f prevCorner(prevPt.x - half, prevPt.y - half);
+    const int ix = (int)floorf(prevCorner.x);
+    const int iy = (int)floorf(prevCorner.y);
+    if (!windowInside<W>(I, ix, iy)) return false;
+
+    // Interpolate the template with a one pixel margin, then take Scharr gradients inside it.
+    alignas(32) int16_t patch[(W+2)*(W+2)];
+    const BilinearWeights wI = bilinearWeights(prevCorner.x - ix, prevCorner.y - iy);
+    for (int y = 0; y < W + 2; ++y) {
+        const uchar* row = I.origin + (iy + y - 1)*I.stride + (ix - 1);
+        for (int x = 0; x < W + 2; ++x) patch[y*(W+2) + x] = interpolatePixel(row + x, I.stride, wI);
+    }
+
+    alignas(32) int16_t Iwin[W*S] = {};
+    alignas(32) int16_t Ix[W*S] = {};
+    alignas(32) int16_t Iy[W*S] = {};
+    float A11 = 0, A12 = 0, A22 = 0;
+    for (int y = 0; y < W; ++y) {
+        const int16_t* above = patch + y*(W+2) + 1;
+        const int16_t* centre = above + (W+2);
+        const int16_t* below = centre + (W+2);
+        int sumXX = 0, sumXY = 0, sumYY = 0;
+        for (int x = 0; x < W; ++x) {
+            // Scharr kernels; dividing by 32 gives gradients on the same scale as the patch values.
+            const int gx = 3*(above[x+1] - above[x-1]) + 10*(centre[x+1] - centre[x-1]) + 3*(below[x+1] - below[x-1]);
+            const int gy = 3*(below[x-1] - above[x-1]) + 10*(below[x] - above[x]) + 3*(below[x+1] - above[x+1]);
+            const int16_t dx = (int16_t)(gx >> 5);
+            const int16_t dy = (int16_t)(gy >> 5);
+            Iwin[y*S + x] = centre[x];
+            Ix[y*S + x] = dx;
+            Iy[y*S + x] = dy;
+            sumXX += dx*dx;
+            sumXY += dx*dy;
+            sumYY += dy*dy;
+        }
+        A11 += sumXX;
+        A12 += sumXY;
+        A22 += sumYY;
+    }
+    A11 *= lkMatrixScale;
+    A12 *= lkMatrixScale;
+    A22 *= lkMatrixScale;
+
+    const float D = A11*A22 - A12*A12;
+    const float minEig = (A22 + A11 - sqrtf((A11 - A22)*(A11 - A22) + 4.f*A12*A12)) / (2*W*W);
+    if (minEig < minEigThreshold || D < FLT_EPSILON) return false;
+    const float invD = 1.f / D;
+
+    Point2f corner(nextPt.x - half, nextPt.y - half);
+    Point2f prevDelta(0, 0);
+    for (int iteration = 0; iteration < maxIterations; ++iteration) {
+        const int jx = (int)floorf(corner.x);
+        const int jy = (int)floorf(corner.y);
+        if (!windowInside<W>(J, jx, jy)) return false;
+
+        const BilinearWeights wJ = bilinearWeights(corner.x - jx, corner.y - jy);
+        float b1, b2;
+        mismatchVector<W>(J.origin + jy*J.stride + jx, J.stride, wJ, Iwin, Ix, Iy, b1, b2);
+        b1 *= lkMatrixScale;
+        b2 *= lkMatrixScale;
+
+        const Point2f delta((A12*b2 - A22*b1) * invD, (A12*b1 - A11*b2) * invD);
+        corner += delta;
+        if (delta.x*delta.x + delta.y*delta.y <= epsilon*epsilon) break;
+
+        // Stop oscillating between two positions by settling halfway.
+        if (iteration > 0 && fabsf(delta.x + prevDelta.x) < 0.01f && fabsf(delta.y + prevDelta.y) < 0.01f) {
+            corner -= delta*0.5f;
+            break;
+        }
+        prevDelta = delta;
+    }
+    nextPt = Point2f(corner.x + half, corner.y + half);
+
+    if (error) {
+        const int jx = (int)floorf(corner.x);
+        const int jy = (int)floorf(corner.y);
+        if (!windowInside<W>(J, jx, jy)) return false;
+        const BilinearWeights wJ = bilinearWeights(corner.x - jx, corner.y - jy);
+        int errorSum = 0;
+        for (int y = 0; y < W; ++y) {
+            const uchar* row = J.origin + (jy + y)*J.stride + jx;
+            for (int x = 0; x < W; ++x) errorSum += abs(interpolatePixel(row + x, J.stride, wJ) - Iwin[y*S + x]);
+        }
+        *error = errorSum / (32.f * W * W);
+    }
+    return true;
+}
+
+typedef bool (*LKLevelFunction)(const LKImageView&, const LKImageView&, const Point2f&, Point2f&, int, float, float, float*);
+
+LKLevelFunction levelFunctionForWindow(int windowSize) {
+    switch (windowSize) {
+    case 7: return &trackPointOnLevel<7>;
+    case 9: return &trackPointOnLevel<9>;
+    case 11: return &trackPointOnLevel<11>;
+    case 13: return &trackPointOnLevel<13>;
+    case 15: return &trackPointOnLevel<15>;
+    case 17: return &trackPointOnLevel<17>;
+    case 19: return &trackPointOnLevel<19>;
+    case 21: return &trackPointOnLevel<21>;
+    default: return nullptr;
+    }
+}
+
+LKImageView levelView(const Mat& paddedLevel) {
+    constexpr int border = PyramidalLK::pyramidBorder;
+    LKImageView view;
+    view.origin = paddedLevel.ptr<uchar>(border) + border;
+    view.stride = paddedLevel.step[0];
+    view.width = paddedLevel.cols - 2*border;
+    view.height = paddedLevel.rows - 2*border;
+    return view;
+}
+
+}
+
+void PyramidalLK::setImage(const Mat& imageGrey, int pyramidLevels) {
+    if (imageGrey.type() != CV_8UC1) throw invalid_argument("PyramidalLK requires CV_8UC1 images.");
+
+    // Reuse the buffers of the pyramid before last for the new one.
+    swap(previousPyramid, currentPyramid);
+
+    currentPyramid.resize(pyramidLevels + 1);
+    levelScratch.resize(pyramidLevels + 1);
+    const Mat* level = &imageGrey;
+    for (int i = 0; i <= pyramidLevels; ++i) {
+        if (i > 0) {
+            pyrDown(*level, levelScratch[i]);
+            level = &levelScratch[i];
+        }
+        copyMakeBorder(*level, currentPyramid[i], pyramidBorder, pyramidBorder, pyramidBorder, pyramidBorder, BORDER_REFLECT_101);
+    }
+}
+
+void PyramidalLK::track(const vector<Point2f>& prevPoints, vector<Point2f>& nextPoints, vector<uchar>& status, vector<float>& error,
+                        const Size& window, int pyramidLevels, bool useInitialFlow) const {
+    if (window.width != window.height) throw invalid_argument("PyramidalLK only supports square windows.");
+    const LKLevelFunction trackLevel = levelFunctionForWindow(window.width);
+    if (!trackLevel) throw invalid_argument("PyramidalLK supports odd window sizes from 7 to 21.");
+
+    const size_t pointCount = prevPoints.size();
+    if (!useInitialFlow || nextPoints.size() != pointCount) nextPoints.assign(prevPoints.begin(), prevPoints.end());
+    status.resize(pointCount);
+    error.resize(pointCount);
+
+    if (previousPyramid.empty() || currentPyramid.empty()) {
+        fill(status.begin(), status.end(), 0);
+        return;
+    }
+    const int maxLevel = min<int>(pyramidLevels, min(previousPyramid.size(), currentPyramid.size()) - 1);
+
+    parallel_for_(Range(0, pointCount), [&](const Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            const float topScale = 1.f / (1 << maxLevel);
+            Point2f nextPt = nextPoints[i] * topScale;
+            bool tracked = true;
+
+            for (int level = maxLevel; level >= 0; --level) {
+                const float scale = 1.f / (1 << level);
+                if (level < maxLevel) nextPt = nextPt * 2.f;
+
+                // Failures on coarse levels are tolerated; the finer levels can still recover.
+                const bool ok = trackLevel(levelView(previousPyramid[level]), levelView(currentPyramid[level]),
+                                           prevPoints[i] * scale, nextPt, maxIterations, epsilon, minEigThreshold,
+                                           level == 0 ? &error[i] : nullptr);
+                if (!ok && level == 0) tracked = false;
+            }
+
+            nextPoints[i] = nextPt;
+            status[i] = tracked;
+            if (!tracked) error[i] = 0;
+        }
+    });
+}
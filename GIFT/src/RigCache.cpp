@@ -0,0 +1,224 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "RigCache.h"
+#include "Configure.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace GIFT;
+using namespace std;
+
+static constexpr char rigCacheMagic[8] = {'G','I','F','T','R','I','G','C'};
+static constexpr uint32_t rigCacheVersion = 1;
+static constexpr int rigCacheMaxDistortion = 16;
+static constexpr size_t rigCacheMapAlignment = 64;
+
+struct RigCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t cameraCount;
+    uint64_t contentHash;
+    int32_t width;
+    int32_t height;
+};
+
+// Matrices are stored row-major.
+struct RigCacheCamera {
+    double K[9];
+    double pose[16];
+    double P[12];
+    double distortion[rigCacheMaxDistortion];
+    uint32_t distortionCount;
+    uint32_t reserved;
+    uint64_t mapOffset; // Offset of the x map in the file; the y map follows it
+};
+
+static size_t alignMapOffset(size_t offset) {
+    return (offset + rigCacheMapAlignment - 1) / rigCacheMapAlignment * rigCacheMapAlignment;
+}
+
+uint64_t RigCache::hashConfiguration(const vector<string>& cameraConfigFiles, const cv::Size& imageSize) {
+    // 64-bit FNV-1a over the version, the image size and the contents of every file.
+    uint64_t hash = 14695981039346656037ULL;
+    auto hashBytes = [&hash](const void* data, size_t size) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+    };
+
+    hashBytes(&rigCacheVersion, sizeof(rigCacheVersion));
+    hashBytes(&imageSize.width, sizeof(imageSize.width));
+    hashBytes(&imageSize.height, sizeof(imageSize.height));
+    for (const string& fileName : cameraConfigFiles) {
+        ifstream file(fileName, ios::binary);
+        if (!file) throw invalid_argument("Could not open the camera configuration " + fileName + ".");
+        const string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        const uint64_t length = contents.size();
+        hashBytes(&length, sizeof(length));
+        hashBytes(contents.data(), contents.size());
+    }
+    return hash;
+}
+
+RigCache::RigCache(const vector<string>& cameraConfigFiles, const string& cacheFile, const cv::Size& imageSize) {
+    const uint64_t contentHash = hashConfiguration(cameraConfigFiles, imageSize);
+    if (loadCache(cacheFile, contentHash, cameraConfigFiles.size(), imageSize)) {
+        cacheHit = true;
+        return;
+    }
+
+    // The cache is missing or stale, so fall back to the YAML path and rebuild it.
+    for (const string& fileName : cameraConfigFiles) {
+        CachedCamera cached;
+        cached.camera = readCameraConfig(fileName);
+        cached.imageSize = imageSize;
+        if (imageSize.area() > 0) {
+            cv::initUndistortRectifyMap(cached.camera.K, cached.camera.distortionParams, cv::Mat(), cached.camera.K,
+                                        imageSize, CV_32FC1, cached.undistortMapX, cached.undistortMapY);
+        }
+        rigCameras.emplace_back(cached);
+    }
+    writeCache(cacheFile, contentHash, imageSize);
+}
+
+bool RigCache::loadCache(const string& cacheFile, uint64_t contentHash, size_t cameraCount, const cv::Size& imageSize) {
+    int fd = open(cacheFile.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(RigCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    const size_t fileSize = fileStat.st_size;
+    void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+    const char* data = static_cast<const char*>(mapping);
+
+    const RigCacheHeader* header = reinterpret_cast<const RigCacheHeader*>(data);
+    const size_t mapBytes = (size_t)imageSize.area() * sizeof(float);
+    const size_t recordsEnd = sizeof(RigCacheHeader) + cameraCount*sizeof(RigCacheCamera);
+    bool valid = memcmp(header->magic, rigCacheMagic, sizeof(header->magic)) == 0
+        && header->version == rigCacheVersion
+        && header->contentHash == contentHash
+        && header->cameraCount == cameraCount
+        && header->width == imageSize.width
+        && header->height == imageSize.height
+        && recordsEnd <= fileSize;
+
+    const RigCacheCamera* records = reinterpret_cast<const RigCacheCamera*>(data + sizeof(RigCacheHeader));
+    for (size_t i = 0; valid && i < cameraCount; ++i) {
+        valid = records[i].distortionCount <= rigCacheMaxDistortion
+            && (mapBytes == 0 || records[i].mapOffset + 2*mapBytes <= fileSize);
+    }
+    if (!valid) {
+        munmap(mapping, fileSize);
+        return false;
+    }
+
+    // The maps point into the mapping, so every camera shares ownership of it.
+    const shared_ptr<const void> mapOwner(mapping, [fileSize](const void* data) { munmap(const_cast<void*>(data), fileSize); });
+    for (size_t i = 0; i < cameraCount; ++i) {
+        const RigCacheCamera& record = records[i];
+
+        cv::Mat K(3, 3, CV_64F);
+        for (int r = 0; r < 3; ++r) for (int c = 0; c < 3; ++c) K.at<double>(r,c) = record.K[3*r+c];
+        Eigen::Matrix4d pose;
+        for (int r = 0; r < 4; ++r) for (int c = 0; c < 4; ++c) pose(r,c) = record.pose[4*r+c];
+        vector<double> distortion(record.distortion, record.distortion + record.distortionCount);
+
+        CachedCamera cached;
+        cached.camera = CameraParameters(K, pose, distortion);
+        for (int r = 0; r < 3; ++r) for (int c = 0; c < 4; ++c) cached.camera.P(r,c) = record.P[4*r+c];
+        cached.imageSize = imageSize;
+        if (mapBytes > 0) {
+            char* mapX = const_cast<char*>(data) + record.mapOffset;
+            cached.undistortMapX = cv::Mat(imageSize, CV_32FC1, mapX);
+            cached.undistortMapY = cv::Mat(imageSize, CV_32FC1, mapX + mapBytes);
+            cached.mapOwner = mapOwner;
+        }
+        rigCameras.emplace_back(cached);
+    }
+    return true;
+}
+
+void RigCache::writeCache(const string& cacheFile, uint64_t contentHash, const cv::Size& imageSize) const {
+    // The cache only saves time, so failing to write it is not an error.
+    const string tempFile = cacheFile + ".tmp";
+    FILE* file = fopen(tempFile.c_str(), "wb");
+    if (!file) return;
+
+    RigCacheHeader header;
+    memcpy(header.magic, rigCacheMagic, sizeof(header.magic));
+    header.version = rigCacheVersion;
+    header.cameraCount = rigCameras.size();
+    header.contentHash = contentHash;
+    header.width = imageSize.width;
+    header.height = imageSize.height;
+    fwrite(&header, sizeof(header), 1, file);
+
+    const size_t mapBytes = (size_t)imageSize.area() * sizeof(float);
+    size_t mapOffset = alignMapOffset(sizeof(RigCacheHeader) + rigCameras.size()*sizeof(RigCacheCamera));
+    bool valid = true;
+    for (const CachedCamera& cached : rigCameras) {
+        RigCacheCamera record;
+        memset(&record, 0, sizeof(record));
+
+        cv::Mat K;
+        cached.camera.K.convertTo(K, CV_64F);
+        for (int r = 0; r < 3; ++r) for (int c = 0; c < 3; ++c) record.K[3*r+c] = K.at<double>(r,c);
+        for (int r = 0; r < 4; ++r) for (int c = 0; c < 4; ++c) record.pose[4*r+c] = cached.camera.pose(r,c);
+        for (int r = 0; r < 3; ++r) for (int c = 0; c < 4; ++c) record.P[4*r+c] = cached.camera.P(r,c);
+
+        const vector<double>& distortion = cached.camera.distortionParams;
+        valid &= distortion.size() <= rigCacheMaxDistortion;
+        record.distortionCount = min<size_t>(distortion.size(), rigCacheMaxDistortion);
+        copy(distortion.begin(), distortion.begin() + record.distortionCount, record.distortion);
+
+        if (mapBytes > 0) {
+            record.mapOffset = mapOffset;
+            mapOffset = alignMapOffset(mapOffset + 2*mapBytes);
+        }
+        fwrite(&record, sizeof(record), 1, file);
+    }
+
+    for (const CachedCamera& cached : rigCameras) {
+        if (mapBytes == 0) break;
+        const long alignedOffset = alignMapOffset(ftell(file));
+        while (ftell(file) < alignedOffset) fputc(0, file);
+        for (const cv::Mat* map : {&cached.undistortMapX, &cached.undistortMapY}) {
+            for (int row = 0; row < map->rows; ++row) fwrite(map->ptr<float>(row), sizeof(float), map->cols, file);
+        }
+    }
+
+    valid &= (fclose(file) == 0);
+    if (valid) rename(tempFile.c_str(), cacheFile.c_str());
+    else remove(tempFile.c_str());
+}
@@ -0,0 +1,278 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "SharedLandmarkTransport.h"
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace GIFT;
+using namespace std;
+
+static constexpr char sharedTransportMagic[8] = {'G','I','F','T','S','H','M','L'};
+static constexpr uint32_t sharedTransportVersion = 1;
+static constexpr size_t sharedTransportAlignment = 64;
+
+static_assert(atomic<uint32_t>::is_always_lock_free && atomic<uint64_t>::is_always_lock_free,
+              "The shared memory transport needs lock free atomics to work across processes.");
+
+namespace GIFT {
+
+// The version is stored last when the publisher has set up the rest, so readers check it first.
+struct SharedTransportHeader {
+    char magic[8];
+    atomic<uint32_t> version;
+    uint32_t slotCount;
+    uint32_t maxLandmarks;
+    uint32_t reserved;
+    uint64_t slotStride;
+    alignas(sharedTransportAlignment) atomic<uint64_t> sequence; // Number of frames published
+};
+
+// The generation is odd while the frame is written. The other fields are atomic so that reading
+// them during a write is well defined; only the arrays rely on the generation check.
+struct SharedFrameHeader {
+    atomic<uint32_t> generation;
+    atomic<int32_t> frameNumber;
+    atomic<uint32_t> count;
+    atomic<uint64_t> sequence;
+};
+
+}
+
+// Byte offsets of the arrays within a frame, each starting on a cache line.
+struct SharedFrameLayout {
+    size_t ids;
+    size_t lifetimes;
+    size_t bearings;
+    size_t flows;
+    size_t stride;
+
+    SharedFrameLayout(uint32_t maxLandmarks) {
+        auto align = [](size_t offset) {
+            return (offset + sharedTransportAlignment - 1) / sharedTransportAlignment * sharedTransportAlignment;
+        };
+        ids = align(sizeof(SharedFrameHeader));
+        lifetimes = align(ids + maxLandmarks*sizeof(int32_t));
+        bearings = align(lifetimes + maxLandmarks*sizeof(int32_t));
+        flows = align(bearings + 3*maxLandmarks*sizeof(float));
+        stride = align(flows + 3*maxLandmarks*sizeof(float));
+    }
+};
+
+static size_t framesOffset() {
+    return (sizeof(SharedTransportHeader) + sharedTransportAlignment - 1) / sharedTransportAlignment * sharedTransportAlignment;
+}
+
+static string systemError(const string& message) {
+    return message + ": " + strerror(errno);
+}
+
+SharedLandmarkPublisher::SharedLandmarkPublisher(const string& name, uint32_t maxLandmarks, uint32_t slotCount) : name(name) {
+    if (slotCount < 2) throw invalid_argument("The shared landmark transport needs at least two slots.");
+    if (maxLandmarks == 0) throw invalid_argument("The shared landmark transport needs room for at least one landmark.");
+
+    // Replace any object left behind by a publisher that did not exit cleanly.
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) throw runtime_error(systemError("Could not create the shared memory object " + name));
+
+    const SharedFrameLayout layout(maxLandmarks);
+    mappedSize = framesOffset() + slotCount*layout.stride;
+    if (ftruncate(fd, mappedSize) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw runtime_error(systemError("Could not size the shared memory object " + name));
+    }
+    void* mapping = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw runtime_error(systemError("Could not map the shared memory object " + name));
+    }
+    mappedData = mapping;
+
+    // The memory starts zeroed, so the frames start with generation zero and no landmarks.
+    char* data = static_cast<char*>(mappedData);
+    SharedTransportHeader* header = new (data) SharedTransportHeader;
+    memcpy(header->magic, sharedTransportMagic, sizeof(header->magic));
+    header->slotCount = slotCount;
+    header->maxLandmarks = maxLandmarks;
+    header->reserved = 0;
+    header->slotStride = layout.stride;
+    header->sequence.store(0, memory_order_relaxed);
+    for (uint32_t i = 0; i < slotCount; ++i) {
+        SharedFrameHeader* slot = new (data + framesOffset() + i*layout.stride) SharedFrameHeader;
+        slot->generation.store(0, memory_order_relaxed);
+        slot->frameNumber.store(0, memory_order_relaxed);
+        slot->count.store(0, memory_order_relaxed);
+        slot->sequence.store(0, memory_order_relaxed);
+    }
+    header->version.store(sharedTransportVersion, memory_order_release);
+}
+
+SharedLandmarkPublisher::~SharedLandmarkPublisher() {
+    // Readers that have the object mapped keep their mapping.
+    if (mappedData) munmap(mappedData, mappedSize);
+    shm_unlink(name.c_str());
+}
+
+void SharedLandmarkPublisher::publish(int frameNumber, const vector<Landmark>& landmarks) {
+    char* data = static_cast<char*>(mappedData);
+    SharedTransportHeader* header = reinterpret_cast<SharedTransportHeader*>(data);
+    const SharedFrameLayout layout(header->maxLandmarks);
+
+    const uint64_t frameSequence = sequence + 1;
+    char* frameData = data + framesOffset() + ((frameSequence - 1) % header->slotCount)*layout.stride;
+    SharedFrameHeader* slot = reinterpret_cast<SharedFrameHeader*>(frameData);
+
+    // Mark the frame as being written before any of it changes.
+    const uint32_t generation = slot->generation.load(memory_order_relaxed);
+    slot->generation.store(generation + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    const uint32_t count = min<size_t>(landmarks.size(), header->maxLandmarks);
+    int32_t* ids = reinterpret_cast<int32_t*>(frameData + layout.ids);
+    int32_t* lifetimes = reinterpret_cast<int32_t*>(frameData + layout.lifetimes);
+    float* bearings = reinterpret_cast<float*>(frameData + layout.bearings);
+    float* flows = reinterpret_cast<float*>(frameData + layout.flows);
+    for (uint32_t i = 0; i < count; ++i) {
+        const Landmark& lm = landmarks[i];
+        ids[i] = lm.idNumber;
+        lifetimes[i] = lm.lifetime;
+        for (int k = 0; k < 3; ++k) {
+            bearings[3*i+k] = lm.sphereCoordinates[k];
+            flows[3*i+k] = lm.opticalFlowSphere[k];
+        }
+    }
+    slot->frameNumber.store(frameNumber, memory_order_relaxed);
+    slot->count.store(count, memory_order_relaxed);
+    slot->sequence.store(frameSequence, memory_order_relaxed);
+
+    slot->generation.store(generation + 2, memory_order_release);
+    header->sequence.store(frameSequence, memory_order_release);
+    sequence = frameSequence;
+}
+
+SharedLandmarkReader::SharedLandmarkReader(const string& name) {
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) throw runtime_error(systemError("Could not open the shared memory object " + name));
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)framesOffset()) {
+        close(fd);
+        throw runtime_error("The shared memory object " + name + " is not a landmark transport.");
+    }
+    mappedSize = fileStat.st_size;
+    const void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) throw runtime_error(systemError("Could not map the shared memory object " + name));
+    mappedData = mapping;
+    header = static_cast<const SharedTransportHeader*>(mappedData);
+
+    const bool valid = header->version.load(memory_order_acquire) == sharedTransportVersion
+        && memcmp(header->magic, sharedTransportMagic, sizeof(header->magic)) == 0
+        && header->slotCount >= 2
+        && header->slotStride == SharedFrameLayout(header->maxLandmarks).stride
+        && framesOffset() + header->slotCount*header->slotStride <= mappedSize;
+    if (!valid) {
+        munmap(const_cast<void*>(mappedData), mappedSize);
+        throw runtime_error("The shared memory object " + name + " is not a landmark transport of version "
+                            + to_string(sharedTransportVersion) + ".");
+    }
+}
+
+SharedLandmarkReader::~SharedLandmarkReader() {
+    if (mappedData) munmap(const_cast<void*>(mappedData), mappedSize);
+}
+
+uint64_t SharedLandmarkReader::publishedFrames() const {
+    return header->sequence.load(memory_order_acquire);
+}
+
+bool SharedLandmarkReader::latest(SharedLandmarkFrame& frame) const {
+    return this->frame(publishedFrames(), frame);
+}
+
+bool SharedLandmarkReader::frame(uint64_t sequence, SharedLandmarkFrame& frame) const {
+    if (sequence == 0 || sequence > publishedFrames()) return false;
+
+    const char* frameData = static_cast<const char*>(mappedData) + framesOffset()
+        + ((sequence - 1) % header->slotCount)*header->slotStride;
+    const SharedFrameHeader* slot = reinterpret_cast<const SharedFrameHeader*>(frameData);
+
+    const uint32_t generation = slot->generation.load(memory_order_acquire);
+    if (generation & 1) return false;
+    const uint64_t slotSequence = slot->sequence.load(memory_order_relaxed);
+    const int32_t frameNumber = slot->frameNumber.load(memory_order_relaxed);
+    const uint32_t count = slot->count.load(memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+    if (slot->generation.load(memory_order_relaxed) != generation || slotSequence != sequence) return false;
+
+    const SharedFrameLayout layout(header->maxLandmarks);
+    frame.sequence = sequence;
+    frame.frameNumber = frameNumber;
+    frame.count = min(count, header->maxLandmarks);
+    frame.ids = reinterpret_cast<const int32_t*>(frameData + layout.ids);
+    frame.lifetimes = reinterpret_cast<const int32_t*>(frameData + layout.lifetimes);
+    frame.bearings = reinterpret_cast<const float*>(frameData + layout.bearings);
+    frame.flows = reinterpret_cast<const float*>(frameData + layout.flows);
+    frame.slot = slot;
+    frame.generation = generation;
+    return true;
+}
+
+bool SharedLandmarkReader::stillValid(const SharedLandmarkFrame& frame) const {
+    if (!frame.slot) return false;
+    atomic_thread_fence(memory_order_acquire);
+    return frame.slot->generation.load(memory_order_relaxed) == frame.generation;
+}
+
+SharedCopyStatus SharedLandmarkReader::copyLatest(vector<Landmark>& landmarks, int* frameNumber, uint64_t* sequence) const {
+    // The latest frame is only overwritten after slotCount-1 more publishes, so retries are rare. When they
+    // happen the publisher is running, so give it the processor to finish the frame before trying again.
+    static constexpr int maxAttempts = 100;
+    SharedLandmarkFrame frame;
+    for (int attempt = 0; attempt < maxAttempts; ++attempt) {
+        if (attempt > 0) this_thread::yield();
+        if (!latest(frame)) {
+            if (publishedFrames() == 0) return SharedCopyStatus::Empty;
+            continue;
+        }
+        landmarks.resize(frame.count);
+        for (uint32_t i = 0; i < frame.count; ++i) {
+            Landmark& lm = landmarks[i];
+            lm.idNumber = frame.ids[i];
+            lm.lifetime = frame.lifetimes[i];
+            lm.sphereCoordinates = Eigen::Vector3d(frame.bearings[3*i], frame.bearings[3*i+1], frame.bearings[3*i+2]);
+            lm.opticalFlowSphere = Eigen::Vector3d(frame.flows[3*i], frame.flows[3*i+1], frame.flows[3*i+2]);
+        }
+        if (stillValid(frame)) {
+            if (frameNumber) *frameNumber = frame.frameNumber;
+            if (sequence) *sequence = frame.sequence;
+            return SharedCopyStatus::Copied;
+        }
+    }
+    return SharedCopyStatus::Contended;
+}
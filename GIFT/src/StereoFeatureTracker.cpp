@@ -16,36 +16,80 @@
 */
 
 #include "StereoFeatureTracker.h"
-#include <set>
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/video/tracking.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include <cmath>
 
 using namespace GIFT;
 
 void StereoFeatureTracker::processImages(const Mat &imageLeft, const Mat &imageRight) {
+    if (stereoMode == StereoMode::Temporal) {
+        trackerLeft.processImage(imageLeft);
+        const shared_ptr<const LandmarkSnapshot> snapshotLeft = trackerLeft.latestSnapshot();
+        propagateStereoLandmarks(snapshotLeft->landmarks, imageLeft, imageRight);
+        publishSnapshot(snapshotLeft, publishRightTemporal(*snapshotLeft));
+        return;
+    }
+
     trackerLeft.processImage(imageLeft);
     trackerRight.processImage(imageRight);
 
-    const vector<Landmark> landmarksLeft = trackerLeft.outputLandmarks();
-    const vector<Landmark> landmarksRight = trackerRight.outputLandmarks();
+    // The published snapshots give the trackers' output without copying it.
+    const shared_ptr<const LandmarkSnapshot> snapshotLeft = trackerLeft.latestSnapshot();
+    const shared_ptr<const LandmarkSnapshot> snapshotRight = trackerRight.latestSnapshot();
+    const vector<Landmark>& landmarksLeft = snapshotLeft->landmarks;
+    const vector<Landmark>& landmarksRight = snapshotRight->landmarks;
 
-    removeLostStereoLandmarks(landmarksLeft, landmarksRight);
+    updateStereoLandmarks(landmarksLeft, landmarksRight);
     vector<StereoLandmark> newStereoLandmarks = createNewStereoLandmarks(landmarksLeft, imageLeft, landmarksRight, imageRight);
     addNewStereoLandmarks(newStereoLandmarks);
+    publishSnapshot(snapshotLeft, snapshotRight);
 }
 
-void StereoFeatureTracker::removeLostStereoLandmarks(const vector<Landmark>& landmarksLeft, const vector<Landmark>& landmarksRight) {
-    set<int> idsLeft, idsRight;
-    for (const Landmark& lm : landmarksLeft) idsLeft.emplace(lm.idNumber);
-    for (const Landmark& lm : landmarksRight) idsRight.emplace(lm.idNumber);
+void StereoFeatureTracker::publishSnapshot(const shared_ptr<const LandmarkSnapshot>& snapshotLeft, const shared_ptr<const LandmarkSnapshot>& snapshotRight) {
+    // The pairs are swapped into the snapshot, and its stale ones become the buffer of the next frame.
+    shared_ptr<StereoLandmarkSnapshot> snapshot = snapshots.acquire();
+    snapshot->frameNumber = ++frameNumber;
+    snapshot->left = snapshotLeft;
+    snapshot->right = snapshotRight;
+    snapshot->stereoLandmarks.swap(stereoLandmarks);
+    snapshots.publish(snapshot);
+    currentSnapshot = snapshot;
+}
 
-    auto checkValidLandmark = [idsLeft, idsRight] (const int idLeft, const int idRight) {return (idsLeft.count(idLeft) * idsRight.count(idRight)); };
+shared_ptr<const LandmarkSnapshot> StereoFeatureTracker::publishRightTemporal(const LandmarkSnapshot& snapshotLeft) {
+    // The right landmarks follow the left tracker's frame, and are swapped into their snapshot like the pairs.
+    shared_ptr<LandmarkSnapshot> snapshot = snapshotsRightTemporal.acquire();
+    snapshot->frameNumber = snapshotLeft.frameNumber;
+    snapshot->landmarks.swap(landmarksRightTemporal);
+    snapshotsRightTemporal.publish(snapshot);
+    return snapshot;
+}
 
-    vector<StereoLandmark>::iterator iter = stereoLandmarks.begin();
-    while (iter != stereoLandmarks.end()) {
-        if (checkValidLandmark(iter->landmarkLeft->idNumber, iter->landmarkRight->idNumber)) {
-            ++iter;
-        } else {
-            iter = stereoLandmarks.erase(iter);
-        }
+const vector<StereoLandmark>& StereoFeatureTracker::currentStereoLandmarks() const {
+    static const vector<StereoLandmark> noStereoLandmarks;
+    return currentSnapshot ? currentSnapshot->stereoLandmarks : noStereoLandmarks;
+}
+
+void StereoFeatureTracker::updateStereoLandmarks(const vector<Landmark>& landmarksLeft, const vector<Landmark>& landmarksRight) {
+    indicesLeft.reset(landmarksLeft.size());
+    for (size_t i = 0; i < landmarksLeft.size(); ++i) indicesLeft.insert(landmarksLeft[i].idNumber, i);
+    indicesRight.reset(landmarksRight.size());
+    for (size_t i = 0; i < landmarksRight.size(); ++i) indicesRight.insert(landmarksRight[i].idNumber, i);
+
+    // Keep the pairs whose landmarks are both still tracked, pointing at their indices in this frame.
+    stereoLandmarks.clear();
+    for (const StereoLandmark& previousLM : currentStereoLandmarks()) {
+        const int indexLeft = indicesLeft.find(previousLM.idLeft);
+        const int indexRight = indicesRight.find(previousLM.idRight);
+        if (indexLeft < 0 || indexRight < 0) continue;
+
+        stereoLandmarks.emplace_back(previousLM);
+        StereoLandmark& stereoLM = stereoLandmarks.back();
+        stereoLM.indexLeft = indexLeft;
+        stereoLM.indexRight = indexRight;
+        ++stereoLM.lifetime;
     }
 }
 
@@ -56,17 +100,200 @@ vector<StereoLandmark> StereoFeatureTracker::createNewStereoLandmarks(const vect
 }
  
 void StereoFeatureTracker::addNewStereoLandmarks(const vector<StereoLandmark>& newStereoLandmarks) {
-    set<int> idsLeft, idsRight;
-    for (const StereoLandmark& lm : this->stereoLandmarks){
-        idsLeft.emplace(lm.landmarkLeft->idNumber);
-        idsRight.emplace(lm.landmarkRight->idNumber);
-    }
+    if (newStereoLandmarks.empty()) return;
 
-    auto checkValidLandmark = [idsLeft, idsRight] (const int idLeft, const int idRight) {return (idsLeft.count(idLeft) * idsRight.count(idRight)); };
+    // A landmark can only belong to one pair. The maps now hold the landmarks already paired.
+    const size_t maxCount = stereoLandmarks.size() + newStereoLandmarks.size();
+    indicesLeft.reset(maxCount);
+    indicesRight.reset(maxCount);
+    for (size_t i = 0; i < stereoLandmarks.size(); ++i) {
+        indicesLeft.insert(stereoLandmarks[i].idLeft, i);
+        indicesRight.insert(stereoLandmarks[i].idRight, i);
+    }
 
     for (const StereoLandmark& stereoLM : newStereoLandmarks) {
-        if (checkValidLandmark(stereoLM.landmarkLeft->idNumber, stereoLM.landmarkRight->idNumber)) {
-            this->stereoLandmarks.emplace_back(stereoLM);
+        const int idLeft = stereoLM.idLeft;
+        const int idRight = stereoLM.idRight;
+        if (indicesLeft.find(idLeft) >= 0 || indicesRight.find(idRight) >= 0) continue;
+
+        indicesLeft.insert(idLeft, stereoLandmarks.size());
+        indicesRight.insert(idRight, stereoLandmarks.size());
+        this->stereoLandmarks.emplace_back(stereoLM);
+    }
+}
+
+void StereoFeatureTracker::propagateStereoLandmarks(const vector<Landmark>& landmarksLeft, const Mat& imageLeft, const Mat& imageRight) {
+    cv::cvtColor(imageLeft, greyLeft, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(imageRight, greyRight, cv::COLOR_BGR2GRAY);
+
+    // The last pairs are looked up in the snapshot they were published in.
+    const vector<StereoLandmark>& previousStereoLandmarks = currentStereoLandmarks();
+    stereoLandmarks.clear();
+    indicesLeft.reset(previousStereoLandmarks.size());
+    for (size_t i = 0; i < previousStereoLandmarks.size(); ++i) indicesLeft.insert(previousStereoLandmarks[i].idLeft, i);
+
+    // Points whose full match failed recently are not matched again until their retry frame.
+    retryIndices.reset(matchRetries.size());
+    for (size_t i = 0; i < matchRetries.size(); ++i) retryIndices.insert(matchRetries[i].first, i);
+    nextMatchRetries.clear();
+    lastDeferredMatches = 0;
+
+    // Follow the pairs that are still tracked on the left along the epipolar line from their last disparity.
+    matchedPrevious.clear();
+    matchedLeft.clear();
+    matchedRightPoints.clear();
+    unmatchedLeft.clear();
+    unmatchedLeftPoints.clear();
+    for (size_t i = 0; i < landmarksLeft.size(); ++i) {
+        const Point2f& pointLeft = landmarksLeft[i].camCoordinates;
+        const int previous = indicesLeft.find(landmarksLeft[i].idNumber);
+        if (previous >= 0) {
+            const StereoLandmark& previousLM = previousStereoLandmarks[previous];
+            const float previousDisparity = currentSnapshot->landmarkLeft(previousLM).camCoordinates.x
+                                          - currentSnapshot->landmarkRight(previousLM).camCoordinates.x;
+            float disparity = previousDisparity;
+            if (refineDisparity(pointLeft, disparity) && abs(disparity - previousDisparity) <= maxDisparityChange) {
+                matchedPrevious.emplace_back(previous);
+                matchedLeft.emplace_back(i);
+                matchedRightPoints.emplace_back(pointLeft.x - disparity, pointLeft.y);
+                continue;
+            }
+        }
+        // Only the ids still tracked are carried on, so the list does not grow.
+        const int retry = retryIndices.find(landmarksLeft[i].idNumber);
+        if (retry >= 0 && matchRetries[retry].second > frameNumber) {
+            nextMatchRetries.emplace_back(matchRetries[retry]);
+            ++lastDeferredMatches;
+            continue;
+        }
+        unmatchedLeft.emplace_back(i);
+        unmatchedLeftPoints.emplace_back(pointLeft);
+    }
+    lastFullMatches = unmatchedLeftPoints.size();
+
+    // New and lost points are matched in full with pyramidal LK, then refined along the epipolar line.
+    if (!unmatchedLeftPoints.empty()) {
+        calcOpticalFlowPyrLK(greyLeft, greyRight, unmatchedLeftPoints, unmatchedRightPoints, matchStatus, matchError);
+        for (size_t j = 0; j < unmatchedLeftPoints.size(); ++j) {
+            const Point2f& pointLeft = unmatchedLeftPoints[j];
+            float disparity = pointLeft.x - unmatchedRightPoints[j].x;
+            if (matchStatus[j] == 0 || abs(unmatchedRightPoints[j].y - pointLeft.y) > stereoThreshold
+                || !refineDisparity(pointLeft, disparity)) {
+                nextMatchRetries.emplace_back(landmarksLeft[unmatchedLeft[j]].idNumber, frameNumber + matchRetryInterval);
+                continue;
+            }
+
+            matchedPrevious.emplace_back(-1);
+            matchedLeft.emplace_back(unmatchedLeft[j]);
+            matchedRightPoints.emplace_back(pointLeft.x - disparity, pointLeft.y);
+        }
+    }
+
+    // Drop the right points that fall in the masked part of the right image.
+    if (!imageMaskRight.empty()) {
+        size_t keptCount = 0;
+        for (size_t k = 0; k < matchedRightPoints.size(); ++k) {
+            if (imageMaskRight.at<uchar>(matchedRightPoints[k]) == 0) {
+                nextMatchRetries.emplace_back(landmarksLeft[matchedLeft[k]].idNumber, frameNumber + matchRetryInterval);
+                continue;
+            }
+            matchedPrevious[keptCount] = matchedPrevious[k];
+            matchedLeft[keptCount] = matchedLeft[k];
+            matchedRightPoints[keptCount] = matchedRightPoints[k];
+            ++keptCount;
         }
+        matchedPrevious.resize(keptCount);
+        matchedLeft.resize(keptCount);
+        matchedRightPoints.resize(keptCount);
     }
-}
\ No newline at end of file
+
+    matchRetries.swap(nextMatchRetries);
+
+    landmarksRightTemporal.clear();
+    if (matchedRightPoints.empty()) return;
+    cv::undistortPoints(matchedRightPoints, matchedRightPointsNorm, cameraRight.K, cameraRight.distortionParams);
+
+    // The right landmarks of continued pairs are updated, so their flow and lifetime carry on.
+    for (size_t k = 0; k < matchedRightPoints.size(); ++k) {
+        const Landmark& landmarkLeft = landmarksLeft[matchedLeft[k]];
+        if (matchedPrevious[k] >= 0) {
+            const StereoLandmark& previousLM = previousStereoLandmarks[matchedPrevious[k]];
+            landmarksRightTemporal.emplace_back(currentSnapshot->landmarkRight(previousLM));
+            landmarksRightTemporal.back().update(matchedRightPoints[k], matchedRightPointsNorm[k], landmarkLeft.pointColor);
+            stereoLandmarks.emplace_back(previousLM);
+            StereoLandmark& stereoLM = stereoLandmarks.back();
+            stereoLM.indexLeft = matchedLeft[k];
+            stereoLM.indexRight = k;
+            ++stereoLM.lifetime;
+        } else {
+            landmarksRightTemporal.emplace_back(matchedRightPoints[k], matchedRightPointsNorm[k], landmarkLeft.idNumber, landmarkLeft.pointColor);
+            stereoLandmarks.emplace_back(landmarkLeft, matchedLeft[k], landmarksRightTemporal.back(), k, ++currentStereoNumber);
+        }
+    }
+}
+
+static float interpolateGrey(const Mat& image, float x, float y) {
+    const int x0 = (int)floor(x);
+    const int y0 = (int)floor(y);
+    const float ax = x - x0;
+    const float ay = y - y0;
+    const uchar* row0 = image.ptr<uchar>(y0);
+    const uchar* row1 = image.ptr<uchar>(y0 + 1);
+    return (1-ay) * ((1-ax)*row0[x0] + ax*row0[x0+1]) + ay * ((1-ax)*row1[x0] + ax*row1[x0+1]);
+}
+
+bool StereoFeatureTracker::refineDisparity(const Point2f& pointLeft, float& disparity) const {
+    // Gauss-Newton on the disparity alone: minimise sum (I_R(x - d, y) - I_L(x, y))^2 over the window.
+    static constexpr int maxHalfWindow = 10;
+    const int half = min(max(disparityWindow / 2, 1), maxHalfWindow);
+    const int side = 2*half + 1;
+
+    auto windowInside = [&](const Mat& image, float x, float y) {
+        return x - half - 1 >= 0 && x + half + 2 < image.cols && y - half >= 0 && y + half + 1 < image.rows;
+    };
+    if (!windowInside(greyLeft, pointLeft.x, pointLeft.y)) return false;
+
+    float patchLeft[(2*maxHalfWindow+1)*(2*maxHalfWindow+1)];
+    for (int v = 0; v < side; ++v) {
+        for (int u = 0; u < side; ++u) {
+            patchLeft[v*side + u] = interpolateGrey(greyLeft, pointLeft.x + u - half, pointLeft.y + v - half);
+        }
+    }
+
+    for (int iteration = 0; iteration < max(disparityIterations, 1); ++iteration) {
+        const float xRight = pointLeft.x - disparity;
+        if (disparity < 0 || disparity > maxDisparity || !windowInside(greyRight, xRight, pointLeft.y)) return false;
+
+        float gradientSquared = 0;
+        float gradientResidual = 0;
+        for (int v = 0; v < side; ++v) {
+            const float y = pointLeft.y + v - half;
+            for (int u = 0; u < side; ++u) {
+                const float x = xRight + u - half;
+                const float residual = interpolateGrey(greyRight, x, y) - patchLeft[v*side + u];
+                const float gradient = 0.5f * (interpolateGrey(greyRight, x + 1, y) - interpolateGrey(greyRight, x - 1, y));
+                gradientSquared += gradient*gradient;
+                gradientResidual += gradient*residual;
+            }
+        }
+        // Without horizontal texture the disparity is not observable.
+        if (gradientSquared < side*side) return false;
+
+        const float step = gradientResidual / gradientSquared;
+        disparity += step;
+        if (abs(step) < 0.01f) break;
+    }
+
+    // The match is judged at the disparity returned, after the last step.
+    const float xRight = pointLeft.x - disparity;
+    if (disparity < 0 || disparity > maxDisparity || !windowInside(greyRight, xRight, pointLeft.y)) return false;
+    float meanAbsResidual = 0;
+    for (int v = 0; v < side; ++v) {
+        const float y = pointLeft.y + v - half;
+        for (int u = 0; u < side; ++u) {
+            meanAbsResidual += abs(interpolateGrey(greyRight, xRight + u - half, y) - patchLeft[v*side + u]);
+        }
+    }
+    meanAbsResidual /= side*side;
+    return meanAbsResidual <= disparityResidualThreshold;
+}
@@ -0,0 +1,67 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackHistory.h"
+#include <algorithm>
+
+using namespace GIFT;
+using namespace std;
+
+void TrackHistory::reset(int length, int slotCount) {
+    historyLength = max(length, 0);
+    slotCount = (historyLength > 0) ? max(slotCount, 0) : 0;
+    positions.assign(slotCount*historyLength, cv::Point2f());
+    bearings.assign(slotCount*historyLength, Eigen::Vector3f::Zero());
+    heads.assign(slotCount, 0);
+    counts.assign(slotCount, 0);
+    freeSlots.clear();
+    for (int slot = slotCount - 1; slot >= 0; --slot) freeSlots.emplace_back(slot);
+}
+
+int TrackHistory::allocate() {
+    if (!enabled()) return -1;
+    if (freeSlots.empty()) {
+        // Grow geometrically. Existing slots keep their place, so their histories are untouched.
+        const int oldCount = slotCount();
+        const int newCount = max(2*oldCount, 16);
+        positions.resize(newCount*historyLength);
+        bearings.resize(newCount*historyLength, Eigen::Vector3f::Zero());
+        heads.resize(newCount, 0);
+        counts.resize(newCount, 0);
+        for (int slot = newCount - 1; slot >= oldCount; --slot) freeSlots.emplace_back(slot);
+    }
+    const int slot = freeSlots.back();
+    freeSlots.pop_back();
+    heads[slot] = historyLength - 1;
+    counts[slot] = 0;
+    return slot;
+}
+
+void TrackHistory::release(int slot) {
+    if (slot < 0 || slot >= slotCount()) return;
+    counts[slot] = 0;
+    freeSlots.emplace_back(slot);
+}
+
+void TrackHistory::push(int slot, const cv::Point2f& position, const Eigen::Vector3d& bearing) {
+    if (slot < 0 || slot >= slotCount()) return;
+    const int entry = (heads[slot] + 1 == historyLength) ? 0 : heads[slot] + 1;
+    heads[slot] = entry;
+    positions[slot*historyLength + entry] = position;
+    bearings[slot*historyLength + entry] = bearing.cast<float>();
+    counts[slot] = min(counts[slot] + 1, historyLength);
+}
@@ -0,0 +1,206 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackLog.h"
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace GIFT;
+using namespace std;
+
+// Bytes per landmark: id, lifetime, 2 pixel coords, 2 normalised coords, 3 sphere flow components.
+static constexpr size_t trackLogBytesPerLandmark = 2*sizeof(int32_t) + 7*sizeof(float);
+
+TrackLogWriter::TrackLogWriter(const string& fileName, int maxBufferedFrames) {
+    if (maxBufferedFrames < 1) throw invalid_argument("The track log needs at least one frame buffer.");
+
+    file = fopen(fileName.c_str(), "wb");
+    if (!file) throw runtime_error("Could not open the track log " + fileName + " for writing.");
+
+    TrackLogFileHeader header;
+    memcpy(header.magic, trackLogMagic, sizeof(header.magic));
+    header.version = trackLogVersion;
+    header.reserved = 0;
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        throw runtime_error("Could not write the header of the track log " + fileName + ".");
+    }
+
+    buffers.resize(maxBufferedFrames);
+    for (int i = 0; i < maxBufferedFrames; ++i) freeBuffers.emplace_back(i);
+
+    writerThread = thread(&TrackLogWriter::writerLoop, this);
+}
+
+TrackLogWriter::~TrackLogWriter() {
+    {
+        lock_guard<mutex> lock(bufferMutex);
+        stopping = true;
+    }
+    bufferQueued.notify_one();
+    writerThread.join();
+    fclose(file);
+}
+
+void TrackLogWriter::writeFrame(const vector<Landmark>& landmarks) {
+    int bufferIndex;
+    {
+        unique_lock<mutex> lock(bufferMutex);
+        bufferFreed.wait(lock, [this] { return !freeBuffers.empty(); });
+        if (!error.empty()) throw runtime_error(error);
+        bufferIndex = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+
+    // Pack the columns. The buffer keeps its capacity, so this does not allocate once warmed up.
+    const uint32_t n = landmarks.size();
+    vector<char>& buffer = buffers[bufferIndex];
+    buffer.resize(sizeof(TrackLogFrameHeader) + n*trackLogBytesPerLandmark);
+
+    TrackLogFrameHeader* frameHeader = reinterpret_cast<TrackLogFrameHeader*>(buffer.data());
+    frameHeader->frameIndex = frameCount++;
+    frameHeader->count = n;
+    frameHeader->blockBytes = n*trackLogBytesPerLandmark;
+
+    int32_t* ids = reinterpret_cast<int32_t*>(buffer.data() + sizeof(TrackLogFrameHeader));
+    int32_t* lifetimes = ids + n;
+    float* camCoordinates = reinterpret_cast<float*>(lifetimes + n);
+    float* camCoordinatesNorm = camCoordinates + 2*n;
+    float* opticalFlowSphere = camCoordinatesNorm + 2*n;
+
+    for (uint32_t i = 0; i < n; ++i) {
+        const Landmark& lm = landmarks[i];
+        ids[i] = lm.idNumber;
+        lifetimes[i] = lm.lifetime;
+        camCoordinates[2*i] = lm.camCoordinates.x;
+        camCoordinates[2*i+1] = lm.camCoordinates.y;
+        camCoordinatesNorm[2*i] = lm.camCoordinatesNorm.x;
+        camCoordinatesNorm[2*i+1] = lm.camCoordinatesNorm.y;
+        opticalFlowSphere[3*i] = lm.opticalFlowSphere.x();
+        opticalFlowSphere[3*i+1] = lm.opticalFlowSphere.y();
+        opticalFlowSphere[3*i+2] = lm.opticalFlowSphere.z();
+    }
+
+    {
+        lock_guard<mutex> lock(bufferMutex);
+        queuedBuffers.emplace_back(bufferIndex);
+    }
+    bufferQueued.notify_one();
+}
+
+void TrackLogWriter::flush() {
+    unique_lock<mutex> lock(bufferMutex);
+    bufferFreed.wait(lock, [this] { return queuedBuffers.empty() && !writing; });
+    if (error.empty() && fflush(file) != 0) error = "Could not flush the track log.";
+    if (!error.empty()) throw runtime_error(error);
+}
+
+string TrackLogWriter::writeError() const {
+    lock_guard<mutex> lock(bufferMutex);
+    return error;
+}
+
+uint64_t TrackLogWriter::framesWritten() const {
+    lock_guard<mutex> lock(bufferMutex);
+    return writtenCount;
+}
+
+void TrackLogWriter::writerLoop() {
+    unique_lock<mutex> lock(bufferMutex);
+    while (true) {
+        bufferQueued.wait(lock, [this] { return stopping || !queuedBuffers.empty(); });
+        if (queuedBuffers.empty()) break; // Only stop once everything queued has been written
+
+        int bufferIndex = queuedBuffers.front();
+        queuedBuffers.pop_front();
+        writing = true;
+
+        // Once a write has failed the file is incomplete, so later frames are dropped.
+        const bool failed = !error.empty();
+        lock.unlock();
+        const vector<char>& buffer = buffers[bufferIndex];
+        const bool written = !failed && fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        lock.lock();
+
+        if (!written && error.empty()) error = "Could not write frame " + to_string(writtenCount) + " to the track log.";
+        writing = false;
+        if (written) ++writtenCount;
+        freeBuffers.emplace_back(bufferIndex);
+        bufferFreed.notify_all();
+    }
+}
+
+TrackLogReader::TrackLogReader(const string& fileName) {
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) throw runtime_error("Could not open the track log " + fileName + " for reading.");
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(TrackLogFileHeader)) {
+        close(fd);
+        throw runtime_error("The track log " + fileName + " is too short.");
+    }
+    mappedSize = fileStat.st_size;
+
+    void* mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) throw runtime_error("Could not map the track log " + fileName + ".");
+    mappedData = static_cast<const char*>(mapping);
+
+    const TrackLogFileHeader* header = reinterpret_cast<const TrackLogFileHeader*>(mappedData);
+    if (memcmp(header->magic, trackLogMagic, sizeof(header->magic)) != 0 || header->version != trackLogVersion) {
+        munmap(mapping, mappedSize);
+        throw runtime_error("The file " + fileName + " is not a supported track log.");
+    }
+
+    // Index the frames. A partially written final frame is ignored, but a block whose size does not match
+    // its landmark count is corrupt, and frame() would read past it.
+    size_t offset = sizeof(TrackLogFileHeader);
+    while (offset + sizeof(TrackLogFrameHeader) <= mappedSize) {
+        const TrackLogFrameHeader* frameHeader = reinterpret_cast<const TrackLogFrameHeader*>(mappedData + offset);
+        if ((uint64_t)frameHeader->count * trackLogBytesPerLandmark != frameHeader->blockBytes) {
+            munmap(mapping, mappedSize);
+            throw runtime_error("The track log " + fileName + " is corrupt at frame " + to_string(frameOffsets.size()) + ".");
+        }
+        size_t blockEnd = offset + sizeof(TrackLogFrameHeader) + frameHeader->blockBytes;
+        if (blockEnd > mappedSize) break;
+        frameOffsets.emplace_back(offset);
+        offset = blockEnd;
+    }
+}
+
+TrackLogReader::~TrackLogReader() {
+    munmap(const_cast<char*>(mappedData), mappedSize);
+}
+
+TrackLogFrame TrackLogReader::frame(size_t i) const {
+    const char* block = mappedData + frameOffsets.at(i);
+    const TrackLogFrameHeader* frameHeader = reinterpret_cast<const TrackLogFrameHeader*>(block);
+
+    TrackLogFrame frame;
+    frame.frameIndex = frameHeader->frameIndex;
+    frame.count = frameHeader->count;
+    frame.ids = reinterpret_cast<const int32_t*>(block + sizeof(TrackLogFrameHeader));
+    frame.lifetimes = frame.ids + frame.count;
+    frame.camCoordinates = reinterpret_cast<const float*>(frame.lifetimes + frame.count);
+    frame.camCoordinatesNorm = frame.camCoordinates + 2*frame.count;
+    frame.opticalFlowSphere = frame.camCoordinatesNorm + 2*frame.count;
+    return frame;
+}
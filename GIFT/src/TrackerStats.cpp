@@ -0,0 +1,71 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackerStats.h"
+#include <algorithm>
+
+using namespace GIFT;
+using namespace std;
+
+double TrackerStats::coveredFraction() const {
+    if (coverage.empty()) return 0.0;
+    const long covered = count_if(coverage.begin(), coverage.end(), [](int cellCount) { return cellCount > 0; });
+    return (double)covered / coverage.size();
+}
+
+int TrackerStats::lifetimeBin(int lifetime) {
+    int bin = 0;
+    while (lifetime > 1 && bin < lifetimeBins - 1) {
+        lifetime >>= 1;
+        ++bin;
+    }
+    return bin;
+}
+
+void TrackerStats::clear() {
+    const int rows = coverageRows;
+    const int cols = coverageCols;
+    vector<int> cells = std::move(coverage);
+    *this = TrackerStats();
+    coverageRows = rows;
+    coverageCols = cols;
+    coverage = std::move(cells);
+    fill(coverage.begin(), coverage.end(), 0);
+}
+
+void TrackerStats::accumulate(const TrackerStats& other) {
+    frames += other.frames;
+    decimatedFrames += other.decimatedFrames;
+    births += other.births;
+    lostTracking += other.lostTracking;
+    lostMask += other.lostMask;
+    lostBudget += other.lostBudget;
+    candidates += other.candidates;
+    rejectedDuplicate += other.rejectedDuplicate;
+    rejectedCap += other.rejectedCap;
+    trackedCount += other.trackedCount;
+    trackingErrorSum += other.trackingErrorSum;
+    for (int i = 0; i < lifetimeBins; ++i) lifetimeHistogram[i] += other.lifetimeHistogram[i];
+
+    // A change of grid starts the coverage counts again.
+    if (coverageRows != other.coverageRows || coverageCols != other.coverageCols || coverage.size() != other.coverage.size()) {
+        coverageRows = other.coverageRows;
+        coverageCols = other.coverageCols;
+        coverage.assign(other.coverage.size(), 0);
+    }
+    for (size_t i = 0; i < coverage.size(); ++i) coverage[i] += other.coverage[i];
+}
@@ -0,0 +1,111 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingBudget.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace GIFT;
+using namespace std;
+
+TrackingBudget::TrackingBudget(double targetLatency, const TrackingEffort& fullTracking, const DetectionEffort& fullDetection)
+    : targetLatency(targetLatency) {
+    if (targetLatency <= 0) throw invalid_argument("The target latency must be positive.");
+
+    // Smaller windows first, then fewer levels and features. Each side of the window shrinks on its own and
+    // stays odd and at least 9 pixels, but never grows past the full window.
+    auto smallerWindow = [](const cv::Size& window, int step) {
+        auto smallerSide = [step](int side) { return min(max(side - 4*step, 9) | 1, side); };
+        return cv::Size(smallerSide(window.width), smallerSide(window.height));
+    };
+    const int M = fullTracking.maxFeatures;
+    const int L = fullTracking.pyramidLevels;
+    trackingLadder = {
+        fullTracking,
+        {M, L, smallerWindow(fullTracking.window, 1)},
+        {M, max(L - 1, 1), smallerWindow(fullTracking.window, 2)},
+        {3*M/4, max(L - 1, 1), smallerWindow(fullTracking.window, 3)},
+        {max(M/2, 1), max(L - 2, 1), smallerWindow(fullTracking.window, 3)},
+        {max(M/3, 1), 1, smallerWindow(fullTracking.window, 3)},
+    };
+
+    // Detect less often, and search only part of the image each time.
+    const double T = fullDetection.featureSearchThreshold;
+    detectionLadder = {
+        fullDetection,
+        {0.8*T, fullDetection.coverage},
+        {0.8*T, 0.5*fullDetection.coverage},
+        {0.6*T, 0.25*fullDetection.coverage},
+    };
+}
+
+const BudgetDecision& TrackingBudget::update(const StageTimes& times) {
+    if ((int)recentTimes.size() != max(recentFrames, 1)) {
+        recentTimes.assign(max(recentFrames, 1), StageTimes());
+        recentCount = 0;
+        nextRecent = 0;
+    }
+    recentTimes[nextRecent] = times;
+    nextRecent = (nextRecent + 1) % recentTimes.size();
+    recentCount = min(recentCount + 1, (int)recentTimes.size());
+    ++framesSinceChange;
+
+    // The budget is a hard limit, so plan for the slowest recent frame rather than the average.
+    StageTimes slowest;
+    for (int i = 0; i < recentCount; ++i) {
+        slowest.tracking = max(slowest.tracking, recentTimes[i].tracking);
+        slowest.detection = max(slowest.detection, recentTimes[i].detection);
+        slowest.total = max(slowest.total, recentTimes[i].total);
+    }
+
+    ++decision.frameNumber;
+    decision.stageTimes = times;
+    decision.estimatedFrameTime = slowest.total;
+    decision.action = BudgetAction::Hold;
+
+    const int cheapestTracking = trackingLadder.size() - 1;
+    const int cheapestDetection = detectionLadder.size() - 1;
+    if (slowest.total > reduceFraction*targetLatency && framesSinceChange >= reduceSettleFrames) {
+        // Cut the stage that costs the most, unless it is already as cheap as it gets.
+        const bool trackingCostsMore = slowest.tracking >= slowest.detection;
+        if ((trackingCostsMore || decision.detectionLevel == cheapestDetection) && decision.trackingLevel < cheapestTracking) {
+            ++decision.trackingLevel;
+            decision.action = BudgetAction::ReduceTracking;
+        } else if (decision.detectionLevel < cheapestDetection) {
+            ++decision.detectionLevel;
+            decision.action = BudgetAction::ReduceDetection;
+        }
+    } else if (slowest.total < increaseFraction*targetLatency && framesSinceChange >= increaseSettleFrames
+               && recentCount == (int)recentTimes.size()) {
+        // Tracking quality matters more than finding new features, so restore it first.
+        if (decision.trackingLevel > 0) {
+            --decision.trackingLevel;
+            decision.action = BudgetAction::IncreaseTracking;
+        } else if (decision.detectionLevel > 0) {
+            --decision.detectionLevel;
+            decision.action = BudgetAction::IncreaseDetection;
+        }
+    }
+
+    // Frames at the old settings say little about the new ones.
+    if (decision.action != BudgetAction::Hold) {
+        framesSinceChange = 0;
+        recentCount = 0;
+        nextRecent = 0;
+    }
+    return decision;
+}
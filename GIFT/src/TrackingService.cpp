@@ -0,0 +1,214 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TrackingService.h"
+#include <stdexcept>
+
+using namespace GIFT;
+using namespace std;
+
+// The service whose result callback the current thread is running, if any
+static thread_local const TrackingService* deliveringService = nullptr;
+
+TrackingService::TrackingService(ResultCallback callback, int threadCount)
+    : callback(callback), pool(threadCount) {}
+
+TrackingService::~TrackingService() {
+    waitIdle();
+}
+
+int TrackingService::addStream(const FeatureTracker& tracker, const StreamOptions& options) {
+    if (options.maxPendingFrames == 0) throw invalid_argument("A stream must allow at least one pending frame.");
+
+    lock_guard<mutex> lock(streamsMutex);
+    streams.emplace_back(make_unique<Stream>());
+    Stream& newStream = *streams.back();
+    newStream.id = streams.size() - 1;
+    newStream.tracker = tracker;
+    newStream.options = options;
+    return newStream.id;
+}
+
+TrackingService::Stream& TrackingService::stream(int streamId) const {
+    lock_guard<mutex> lock(streamsMutex);
+    if (streamId < 0 || streamId >= (int)streams.size()) throw invalid_argument("There is no stream " + to_string(streamId) + ".");
+    return *streams[streamId];
+}
+
+bool TrackingService::submitFrame(int streamId, const Mat& image) {
+    Stream& s = stream(streamId);
+    unique_lock<mutex> lock(s.mutex);
+
+    bool dropped = false;
+    if (s.pendingFrames >= s.options.maxPendingFrames) {
+        if (s.options.dropPolicy == FrameDropPolicy::DropOldest && !s.waitingFrames.empty()) {
+            s.waitingFrames.pop_front();
+            --s.pendingFrames;
+            ++s.droppedFrames;
+            dropped = true;
+            lock_guard<mutex> idleLock(idleMutex);
+            --totalPendingFrames;
+        } else {
+            // Frames already being processed cannot be dropped, so wait for one of them. Inside a callback that
+            // could wait forever, since the frame being delivered only leaves once the callback returns.
+            if (deliveringService == this) {
+                throw logic_error("submitFrame cannot wait for room inside a result callback. Use trySubmitFrame or DropOldest.");
+            }
+            s.frameDelivered.wait(lock, [&s]() { return s.pendingFrames < s.options.maxPendingFrames; });
+        }
+    }
+
+    queueFrame(s, image);
+    return !dropped;
+}
+
+bool TrackingService::trySubmitFrame(int streamId, const Mat& image) {
+    Stream& s = stream(streamId);
+    lock_guard<mutex> lock(s.mutex);
+    if (s.pendingFrames >= s.options.maxPendingFrames) return false;
+    queueFrame(s, image);
+    return true;
+}
+
+void TrackingService::queueFrame(Stream& s, const Mat& image) {
+    // Called with the stream locked.
+    s.waitingFrames.emplace_back(s.nextFrameIndex++, image);
+    ++s.pendingFrames;
+    {
+        lock_guard<mutex> idleLock(idleMutex);
+        ++totalPendingFrames;
+    }
+
+    // Only one tracking job per stream exists at a time, which keeps the frames in order.
+    if (!s.trackingScheduled) {
+        s.trackingScheduled = true;
+        pool.submit([this, &s]() { runTracking(s); });
+    }
+}
+
+void TrackingService::runTracking(Stream& s) {
+    pair<long, Mat> frame;
+    {
+        lock_guard<mutex> lock(s.mutex);
+        if (s.waitingFrames.empty()) {
+            s.trackingScheduled = false;
+            return;
+        }
+        frame = move(s.waitingFrames.front());
+        s.waitingFrames.pop_front();
+    }
+
+    StreamResult result;
+    result.streamId = s.id;
+    result.frameIndex = frame.first;
+    try {
+        s.tracker.processImage(frame.second);
+        result.landmarks = s.tracker.latestSnapshot();
+        // Decimated frames have no flow to estimate the ego-motion from.
+        if (s.options.computeEgoMotion && s.options.predictFromEgoMotion && !result.landmarks->decimation.decimated) {
+            result.egoMotion.emplace(result.landmarks->landmarks, result.landmarks->decimation.flowInterval);
+            s.tracker.predictFromEgoMotion(*result.egoMotion);
+        }
+    } catch (const exception& e) {
+        result.error = e.what();
+    }
+
+    // Results pass through the ego-motion stage in order, even if there is nothing left to compute for them.
+    const bool egoMotionStage = s.options.computeEgoMotion && !s.options.predictFromEgoMotion;
+    if (egoMotionStage) {
+        lock_guard<mutex> lock(s.mutex);
+        s.waitingResults.emplace_back(move(result));
+        if (!s.egoMotionScheduled) {
+            s.egoMotionScheduled = true;
+            pool.submit([this, &s]() { runEgoMotion(s); });
+        }
+    } else {
+        deliver(s, result);
+    }
+
+    // Go to the back of the queue for the next frame, so the other streams get their turn.
+    lock_guard<mutex> lock(s.mutex);
+    if (s.waitingFrames.empty()) {
+        s.trackingScheduled = false;
+    } else {
+        pool.submit([this, &s]() { runTracking(s); });
+    }
+}
+
+void TrackingService::runEgoMotion(Stream& s) {
+    StreamResult result;
+    {
+        lock_guard<mutex> lock(s.mutex);
+        result = move(s.waitingResults.front());
+        s.waitingResults.pop_front();
+    }
+
+    if (result.error.empty() && !result.landmarks->decimation.decimated) {
+        try {
+            result.egoMotion.emplace(result.landmarks->landmarks, result.landmarks->decimation.flowInterval);
+        } catch (const exception& e) {
+            result.error = e.what();
+        }
+    }
+    deliver(s, result);
+
+    lock_guard<mutex> lock(s.mutex);
+    if (s.waitingResults.empty()) {
+        s.egoMotionScheduled = false;
+    } else {
+        pool.submit([this, &s]() { runEgoMotion(s); });
+    }
+}
+
+void TrackingService::deliver(Stream& s, const StreamResult& result) {
+    if (callback) {
+        deliveringService = this;
+        callback(result);
+        deliveringService = nullptr;
+    }
+
+    {
+        lock_guard<mutex> lock(s.mutex);
+        --s.pendingFrames;
+    }
+    s.frameDelivered.notify_all();
+
+    lock_guard<mutex> idleLock(idleMutex);
+    if (--totalPendingFrames == 0) idle.notify_all();
+}
+
+void TrackingService::waitIdle() {
+    if (deliveringService == this) throw logic_error("waitIdle cannot be called inside a result callback.");
+    unique_lock<mutex> lock(idleMutex);
+    idle.wait(lock, [this]() { return totalPendingFrames == 0; });
+}
+
+shared_ptr<const LandmarkSnapshot> TrackingService::latestSnapshot(int streamId) const {
+    return stream(streamId).tracker.latestSnapshot();
+}
+
+size_t TrackingService::pendingFrames(int streamId) const {
+    Stream& s = stream(streamId);
+    lock_guard<mutex> lock(s.mutex);
+    return s.pendingFrames;
+}
+
+size_t TrackingService::droppedFrames(int streamId) const {
+    Stream& s = stream(streamId);
+    lock_guard<mutex> lock(s.mutex);
+    return s.droppedFrames;
+}
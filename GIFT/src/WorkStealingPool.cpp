@@ -0,0 +1,89 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "WorkStealingPool.h"
+
+using namespace GIFT;
+using namespace std;
+
+// The pool and queue index of the calling thread, if it is a worker.
+static thread_local const WorkStealingPool* currentPool = nullptr;
+static thread_local int currentQueue = -1;
+
+WorkStealingPool::WorkStealingPool(int threadCount) {
+    if (threadCount <= 0) threadCount = max(1u, thread::hardware_concurrency());
+    for (int i = 0; i < threadCount; ++i) queues.emplace_back(make_unique<WorkerQueue>());
+    for (int i = 0; i < threadCount; ++i) threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    jobQueued.notify_all();
+    for (thread& worker : threads) worker.join();
+}
+
+void WorkStealingPool::submit(function<void()> job) {
+    const int index = (currentPool == this) ? currentQueue : nextQueue++ % queues.size();
+    // Count the job before queueing it, so the count never drops below the number of queued jobs.
+    ++queuedJobs;
+    {
+        lock_guard<mutex> lock(queues[index]->mutex);
+        queues[index]->jobs.emplace_back(move(job));
+    }
+
+    // Taking the lock orders the count against a worker that is about to sleep.
+    {
+        lock_guard<mutex> lock(sleepMutex);
+    }
+    jobQueued.notify_one();
+}
+
+bool WorkStealingPool::takeJob(int index, function<void()>& job) {
+    // Own queue first, then steal from the others in turn.
+    for (size_t offset = 0; offset < queues.size(); ++offset) {
+        WorkerQueue& queue = *queues[(index + offset) % queues.size()];
+        lock_guard<mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) continue;
+        job = move(queue.jobs.front());
+        queue.jobs.pop_front();
+        --queuedJobs;
+        return true;
+    }
+    return false;
+}
+
+void WorkStealingPool::workerLoop(int index) {
+    currentPool = this;
+    currentQueue = index;
+
+    function<void()> job;
+    while (true) {
+        if (takeJob(index, job)) {
+            job();
+            job = nullptr;
+            continue;
+        }
+
+        unique_lock<mutex> lock(sleepMutex);
+        jobQueued.wait(lock, [this]() { return stopping || queuedJobs > 0; });
+        // Jobs still queued when the pool stops are run before the workers exit.
+        if (stopping && queuedJobs == 0) return;
+    }
+}
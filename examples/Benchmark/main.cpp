@@ -0,0 +1,108 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "iostream"
+#include "string"
+#include "vector"
+#include <chrono>
+#include <stdexcept>
+
+#include "opencv2/core/core.hpp"
+
+#include "FeatureTracker.h"
+#include "Configure.h"
+#include "FrameSource.h"
+
+// Runs one tracker per configuration on the same frames and compares their run time and how long tracks survive.
+struct BenchmarkRun {
+    std::string name;
+    GIFT::FeatureTracker tracker;
+    double totalSeconds = 0;
+    double totalLandmarks = 0;
+    double totalLifetime = 0;
+    double totalPreviousLandmarks = 0;
+    double totalSurvivors = 0;
+};
+
+int main(int argc, char *argv[]) {
+
+    cv::String camConfigFile;
+    cv::String videoFile;
+    int maxCount = 1000;
+    if (argc == 3 || argc == 4) {
+        camConfigFile = argv[1];
+        videoFile = argv[2];
+        if (argc == 4) maxCount = std::stoi(argv[3]);
+    } else {
+        throw std::runtime_error("Usage: Benchmark <camera calibration> <video file> [max frames]");
+    }
+
+    GIFT::CameraParameters cam0 = GIFT::readCameraConfig(camConfigFile);
+    std::vector<BenchmarkRun> runs;
+    auto addRun = [&](const std::string& name, GIFT::TrackingBackend backend, std::shared_ptr<GIFT::CornerDetector> detector) {
+        BenchmarkRun run;
+        run.name = name;
+        run.tracker = GIFT::FeatureTracker(cam0);
+        run.tracker.maxFeatures = 250;
+        run.tracker.featureDist = 20;
+        run.tracker.trackingBackend = backend;
+        run.tracker.cornerDetector = detector;
+        runs.emplace_back(run);
+    };
+    addRun("OpenCV LK, Shi-Tomasi", GIFT::TrackingBackend::OpenCV, nullptr);
+    addRun("Builtin LK, Shi-Tomasi", GIFT::TrackingBackend::Builtin, nullptr);
+    addRun("Builtin LK, FAST", GIFT::TrackingBackend::Builtin, std::make_shared<GIFT::FASTDetector>());
+    addRun("Builtin LK, AGAST", GIFT::TrackingBackend::Builtin, std::make_shared<GIFT::AGASTDetector>());
+    addRun("Builtin LK, grid FAST", GIFT::TrackingBackend::Builtin,
+           std::make_shared<GIFT::GridDetector>(std::make_shared<GIFT::FASTDetector>(10)));
+    addRun("Builtin LK, grid Shi-Tomasi", GIFT::TrackingBackend::Builtin,
+           std::make_shared<GIFT::GridDetector>(std::make_shared<GIFT::ShiTomasiDetector>()));
+
+    GIFT::PrefetchingFrameSource frames(std::make_unique<GIFT::VideoFrameSource>(videoFile));
+
+    cv::Mat image;
+    int count = 0;
+    while (count < maxCount && frames.read(image)) {
+        ++count;
+        for (auto& run : runs) {
+            const size_t previousLandmarks = run.tracker.outputLandmarks().size();
+            const auto start = std::chrono::steady_clock::now();
+            run.tracker.processImage(image);
+            const auto end = std::chrono::steady_clock::now();
+            run.totalSeconds += std::chrono::duration<double>(end - start).count();
+
+            // Landmarks with a lifetime above one were tracked from the previous frame.
+            for (const auto& lm : run.tracker.outputLandmarks()) {
+                run.totalLifetime += lm.lifetime;
+                if (lm.lifetime > 1) ++run.totalSurvivors;
+            }
+            run.totalLandmarks += run.tracker.outputLandmarks().size();
+            run.totalPreviousLandmarks += previousLandmarks;
+        }
+    }
+
+    std::cout << "Processed " << count << " frames." << std::endl;
+    for (const auto& run : runs) {
+        std::cout << run.name << ": "
+                  << 1000.0 * run.totalSeconds / std::max(count, 1) << " ms per frame, "
+                  << run.totalLandmarks / std::max(count, 1) << " landmarks per frame, "
+                  << 100.0 * run.totalSurvivors / std::max(run.totalPreviousLandmarks, 1.0) << "% tracked per frame, "
+                  << "mean landmark lifetime " << run.totalLifetime / std::max(run.totalLandmarks, 1.0) << " frames."
+                  << std::endl;
+    }
+
+}
@@ -28,6 +28,7 @@
 #include "FeatureTracker.h"
 #include "Configure.h"
 #include "EgoMotion.h"
+#include "FrameSource.h"
 
 int main(int argc, char *argv[]) {
 
@@ -49,13 +50,14 @@ int main(int argc, char *argv[]) {
     ft.maxFeatures = 250;
     ft.featureDist = 20;
 
-    cv::VideoCapture cap(videoFile);
+    // Decode ahead on a background thread while the current frame is tracked
+    GIFT::PrefetchingFrameSource frames(std::make_unique<GIFT::VideoFrameSource>(videoFile));
 
     cv::Mat image;
     int count = 0;
     int maxCount = 1000;
 
-    while (cap.read(image) && ++count < maxCount) {
+    while (frames.read(image) && ++count < maxCount) {
 
         // Track the features
         ft.processImage(image);
@@ -68,6 +70,9 @@ int main(int argc, char *argv[]) {
         std::cout << "Estimated Angular Velocity:" << std::endl;
         std::cout << egoMotion.angularVelocity << '\n' << std::endl;
 
+        // Seed the next frame's tracking with the flow predicted from this estimate
+        ft.predictFromEgoMotion(egoMotion);
+
         auto estFlows = egoMotion.estimateFlowsNorm(landmarks);
 
         cv::Mat flowImage = ft.drawFlowImage(Scalar(0,0,255), Scalar(0,255,255), 3, 2);
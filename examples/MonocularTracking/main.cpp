@@ -17,6 +17,7 @@
 
 #include "FeatureTracker.h"
 #include "Configure.h"
+#include "FrameSource.h"
 
 #include "opencv2/highgui/highgui.hpp"
 
@@ -24,10 +25,9 @@ int main(int argc, char *argv[]) {
 
     GIFT::FeatureTracker ft(GIFT::readCameraConfig(cv::String(argv[1])));
 
-    cv::VideoCapture cap;
-    cap.open(cv::String(argv[2]));
+    GIFT::PrefetchingFrameSource frames(std::make_unique<GIFT::VideoFrameSource>(cv::String(argv[2])));
     cv::Mat image;
-    while (cap.read(image)) {;
+    while (frames.read(image)) {;
 
         ft.processImage(image);
         std::vector<GIFT::Landmark> landmarks = ft.outputLandmarks();
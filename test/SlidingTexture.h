@@ -0,0 +1,36 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <vector>
+
+// Frames of a smooth random texture, viewed through a 320x240 window that slides one pixel right and half a
+// pixel down per frame. At most 80 frames fit in the texture.
+inline std::vector<cv::Mat> slidingTextureFrames(int frameCount) {
+    cv::Mat texture(300, 400, CV_8UC3);
+    cv::randu(texture, cv::Scalar::all(0), cv::Scalar::all(255));
+    cv::GaussianBlur(texture, texture, cv::Size(7,7), 2.0);
+
+    std::vector<cv::Mat> frames;
+    for (int i = 0; i < frameCount; ++i) {
+        frames.emplace_back(texture(cv::Rect(i, i/2, 320, 240)).clone());
+    }
+    return frames;
+}
@@ -0,0 +1,225 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "CornerDetector.h"
+#include "FeatureTracker.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "SlidingTexture.h"
+#include <algorithm>
+#include <vector>
+
+class CornerDetectorTest : public ::testing::Test {
+protected:
+    CornerDetectorTest() {
+        cv::cvtColor(frames[0], grey, cv::COLOR_BGR2GRAY);
+    }
+
+    static constexpr int frameCount = 30;
+    std::vector<cv::Mat> frames = slidingTextureFrames(frameCount);
+    cv::Mat grey;
+};
+
+// Checks the contract of CornerDetector::detect.
+static void expectValidCorners(const std::vector<cv::Point2f>& corners, const cv::Mat& mask, int maxCorners,
+                               double minDistance) {
+    EXPECT_LE((int)corners.size(), maxCorners);
+    for (size_t i = 0; i < corners.size(); ++i) {
+        if (!mask.empty()) {
+            EXPECT_NE(mask.at<uchar>(cv::Point(corners[i])), 0);
+        }
+        for (size_t j = 0; j < i; ++j) EXPECT_GE(cv::norm(corners[i] - corners[j]), minDistance);
+    }
+}
+
+TEST_F(CornerDetectorTest, CornerResponseCacheReusesUnchangedTiles) {
+    constexpr int maxCorners = 100;
+    constexpr double minDistance = 10;
+    constexpr int tileSize = 32;
+    GIFT::CornerResponseCache cache(tileSize, 2.0);
+    const int tileCount = ((grey.cols + tileSize - 1) / tileSize) * ((grey.rows + tileSize - 1) / tileSize);
+
+    std::vector<cv::Point2f> corners, cachedCorners, expected;
+    cache.detect(grey, cv::Mat(), maxCorners, minDistance, corners);
+    EXPECT_EQ(cache.recomputedTiles(), tileCount);
+    EXPECT_EQ(cache.reusedTiles(), 0);
+
+    // The corners are those of goodFeaturesToTrack, up to the order of equal responses.
+    cv::goodFeaturesToTrack(grey, expected, maxCorners, cache.qualityLevel, minDistance);
+    ASSERT_FALSE(expected.empty());
+    EXPECT_EQ(corners.size(), expected.size());
+    int matched = 0;
+    for (const auto& corner : expected) matched += std::count(corners.begin(), corners.end(), corner);
+    EXPECT_GE(matched, 0.9*expected.size());
+
+    // An unchanged image is not recomputed.
+    cache.detect(grey, cv::Mat(), maxCorners, minDistance, cachedCorners);
+    EXPECT_EQ(cache.recomputedTiles(), 0);
+    EXPECT_EQ(cachedCorners, corners);
+
+    // A change inside one tile, up to its right edge, also reaches the responses near the edges of the tiles
+    // around it. Those are recomputed too, and the map matches one computed from scratch.
+    grey(cv::Rect(4*tileSize + 16, 3*tileSize + 8, 16, 16)).setTo(cv::Scalar(0));
+    cache.detect(grey, cv::Mat(), maxCorners, minDistance, corners);
+    EXPECT_EQ(cache.recomputedTiles(), 9);
+    EXPECT_EQ(cache.reusedTiles(), tileCount - 9);
+    GIFT::CornerResponseCache fresh(tileSize, 2.0);
+    fresh.detect(grey, cv::Mat(), maxCorners, minDistance, expected);
+    EXPECT_EQ(corners, expected);
+
+    // Regions of the same image share the cache.
+    cache.detect(grey(cv::Rect(0, 64, grey.cols, 64)), cv::Mat(), maxCorners, minDistance, corners);
+    EXPECT_EQ(cache.recomputedTiles(), 0);
+    EXPECT_GT(cache.reusedTiles(), 0);
+
+    // A change just outside the tiles a region covers reaches the responses of the tiles next to it, which
+    // are recomputed, so the map stays right for the next detection over the whole image.
+    grey(cv::Rect(0, tileSize - 8, 2*tileSize, 8)).setTo(cv::Scalar(255));
+    cache.detect(grey(cv::Rect(0, 64, grey.cols, 64)), cv::Mat(), maxCorners, minDistance, corners);
+    EXPECT_EQ(cache.recomputedTiles(), 3);
+    cache.detect(grey, cv::Mat(), maxCorners, minDistance, corners);
+    EXPECT_EQ(cache.recomputedTiles(), 3);
+    fresh.clear();
+    fresh.detect(grey, cv::Mat(), maxCorners, minDistance, expected);
+    EXPECT_EQ(corners, expected);
+
+    // The tracker detects with it as with any other detector.
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.detectionCoverage = 0.5;
+    ft.cornerDetector = std::make_shared<GIFT::CornerResponseCache>();
+    for (int i = 0; i < frameCount; ++i) {
+        ft.processImage(frames[i]);
+        EXPECT_FALSE(ft.outputLandmarks().empty());
+    }
+}
+
+TEST_F(CornerDetectorTest, CopiesCloneTheDetector) {
+    auto cache = std::make_shared<GIFT::CornerResponseCache>(16, 3.0);
+    cache->qualityLevel = 0.05;
+    cache->blockSize = 5;
+    std::vector<cv::Point2f> corners;
+    cache->detect(grey, cv::Mat(), 100, 10, corners);
+
+    // The copy has the same settings, and a cache of its own that starts empty.
+    const GIFT::CornerDetectorPtr detector = cache;
+    const GIFT::CornerDetectorPtr copy = detector;
+    ASSERT_TRUE(copy);
+    EXPECT_NE(copy.get(), detector.get());
+    auto copiedCache = std::dynamic_pointer_cast<GIFT::CornerResponseCache>(copy.get());
+    ASSERT_TRUE(copiedCache);
+    EXPECT_EQ(copiedCache->tileSize, 16);
+    EXPECT_EQ(copiedCache->changeThreshold, 3.0);
+    EXPECT_EQ(copiedCache->qualityLevel, 0.05);
+    EXPECT_EQ(copiedCache->blockSize, 5);
+    std::vector<cv::Point2f> copiedCorners;
+    copiedCache->detect(grey, cv::Mat(), 100, 10, copiedCorners);
+    EXPECT_EQ(copiedCache->reusedTiles(), 0);
+    EXPECT_EQ(copiedCorners, corners);
+
+    // A grid clones its cell detector along with it.
+    GIFT::GridDetector grid(cache, 2, 2);
+    auto copiedGrid = std::dynamic_pointer_cast<GIFT::GridDetector>(grid.clone());
+    ASSERT_TRUE(copiedGrid);
+    EXPECT_NE(copiedGrid->cellDetector, grid.cellDetector);
+    EXPECT_TRUE(std::dynamic_pointer_cast<GIFT::CornerResponseCache>(copiedGrid->cellDetector));
+
+    // So does a tracker.
+    GIFT::FeatureTracker ft;
+    ft.cornerDetector = cache;
+    const GIFT::FeatureTracker copiedTracker = ft;
+    EXPECT_NE(copiedTracker.cornerDetector.get(), ft.cornerDetector.get());
+}
+
+TEST_F(CornerDetectorTest, KeyPointDetectorsKeepTheirLimits) {
+    constexpr int maxCorners = 50;
+    constexpr double minDistance = 15;
+    cv::Mat mask = cv::Mat::zeros(grey.size(), CV_8UC1);
+    mask(cv::Rect(grey.cols/2, 0, grey.cols/2, grey.rows)).setTo(255);
+
+    // The blurred texture has little contrast, so the thresholds are low.
+    std::vector<std::shared_ptr<GIFT::CornerDetector>> detectors = {
+        std::make_shared<GIFT::FASTDetector>(5), std::make_shared<GIFT::AGASTDetector>(5)};
+    for (const auto& detector : detectors) {
+        std::vector<cv::Point2f> corners;
+        detector->detect(grey, cv::Mat(), maxCorners, minDistance, corners);
+        EXPECT_EQ((int)corners.size(), maxCorners);
+        expectValidCorners(corners, cv::Mat(), maxCorners, minDistance);
+
+        // Without a spacing, the corners are the ones with the strongest response.
+        std::vector<cv::Point2f> unspaced;
+        detector->detect(grey, cv::Mat(), 2*maxCorners, 0, unspaced);
+        EXPECT_EQ((int)unspaced.size(), 2*maxCorners);
+        EXPECT_EQ(corners.front(), unspaced.front());
+
+        detector->detect(grey, mask, maxCorners, minDistance, corners);
+        EXPECT_EQ((int)corners.size(), maxCorners);
+        expectValidCorners(corners, mask, maxCorners, minDistance);
+
+        detector->detect(grey, cv::Mat(), 0, minDistance, corners);
+        EXPECT_TRUE(corners.empty());
+    }
+}
+
+TEST_F(CornerDetectorTest, GridDetectorSharesCornersBetweenCells) {
+    constexpr int maxCorners = 30;
+    constexpr double minDistance = 10;
+    const cv::Size cellSize(grey.cols/2, grey.rows/2);
+    auto cellOf = [&](const cv::Point2f& corner) {
+        return (corner.y >= cellSize.height ? 2 : 0) + (corner.x >= cellSize.width ? 1 : 0);
+    };
+
+    // The top left cell has much less contrast than the rest of the image.
+    cv::Mat weakGrey = grey.clone();
+    cv::Mat weakCell = weakGrey(cv::Rect(cv::Point(0,0), cellSize));
+    weakCell.convertTo(weakCell, -1, 0.5, 64);
+
+    const auto fast = std::make_shared<GIFT::FASTDetector>(3);
+    std::vector<cv::Point2f> plainCorners;
+    fast->detect(weakGrey, cv::Mat(), maxCorners, minDistance, plainCorners);
+    const int plainWeakCorners = std::count_if(plainCorners.begin(), plainCorners.end(),
+                                               [&](const cv::Point2f& corner) { return cellOf(corner) == 0; });
+
+    // Each of the 2x2 cells gets its share of the corners, the first ones getting the remainder.
+    GIFT::GridDetector grid(fast, 2, 2);
+    std::vector<cv::Point2f> corners;
+    grid.detect(weakGrey, cv::Mat(), maxCorners, minDistance, corners);
+    expectValidCorners(corners, cv::Mat(), maxCorners, minDistance);
+    std::vector<int> cellCounts(4, 0);
+    for (const auto& corner : corners) ++cellCounts[cellOf(corner)];
+    const std::vector<int> quotas = {8, 8, 7, 7};
+    for (int cell = 0; cell < 4; ++cell) {
+        EXPECT_LE(cellCounts[cell], quotas[cell]);
+        // Corners near the edges of the cells may still be too close to those of the cells before.
+        EXPECT_GE(cellCounts[cell], quotas[cell] - 2);
+    }
+    EXPECT_GT(cellCounts[0], plainWeakCorners);
+
+    // Masked cells get no corners, and do not pass their share on.
+    cv::Mat mask = cv::Mat::zeros(grey.size(), CV_8UC1);
+    mask(cv::Rect(0, cellSize.height, grey.cols, grey.rows - cellSize.height)).setTo(255);
+    grid.detect(weakGrey, mask, maxCorners, minDistance, corners);
+    expectValidCorners(corners, mask, maxCorners, minDistance);
+    EXPECT_LE((int)corners.size(), quotas[2] + quotas[3]);
+    EXPECT_GE((int)corners.size(), quotas[2] + quotas[3] - 4);
+
+    // Fewer corners than cells go to the first cells.
+    grid.detect(weakGrey, cv::Mat(), 3, minDistance, corners);
+    ASSERT_EQ(corners.size(), 3u);
+    for (int cell = 0; cell < 3; ++cell) EXPECT_EQ(cellOf(corners[cell]), cell);
+}
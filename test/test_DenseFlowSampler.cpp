@@ -0,0 +1,136 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "DenseFlowSampler.h"
+#include "Landmark.h"
+#include "SlidingTexture.h"
+#include <algorithm>
+#include <vector>
+
+// The texture moves by (-2,-1) pixels from frame 0 to frame 2. Samples are 16 pixels apart and centred in their
+// cells, giving a grid of 20 by 15 over the 320x240 frames, none of which leave the image.
+class DenseFlowSamplerTest : public ::testing::Test {
+protected:
+    DenseFlowSamplerTest() {
+        K.at<double>(0,0) = 500;
+        K.at<double>(1,1) = 500;
+        K.at<double>(0,2) = 160;
+        K.at<double>(1,2) = 120;
+    }
+
+    GIFT::DenseFlowSampler shiftedSampler() const {
+        GIFT::DenseFlowSampler sampler{GIFT::CameraParameters(K)};
+        EXPECT_FALSE(sampler.processImage(frames[0]));
+        EXPECT_TRUE(sampler.sphereFlows().empty());
+        return sampler;
+    }
+
+    static constexpr int frameCount = 3;
+    std::vector<cv::Mat> frames = slidingTextureFrames(frameCount);
+    cv::Mat K = cv::Mat::eye(3, 3, CV_64F);
+};
+
+TEST_F(DenseFlowSamplerTest, SamplesFollowTheShift) {
+    // With OpenCV 3 every quality is a Farneback setting, and with OpenCV 4 a DIS preset.
+    for (GIFT::DenseFlowQuality quality : {GIFT::DenseFlowQuality::UltraFast, GIFT::DenseFlowQuality::Fast,
+                                           GIFT::DenseFlowQuality::Medium}) {
+        GIFT::DenseFlowSampler sampler = shiftedSampler();
+        sampler.quality = quality;
+        ASSERT_TRUE(sampler.processImage(frames[2]));
+        EXPECT_EQ(sampler.sphereFlows().size(), 20u*15u);
+
+        std::vector<float> flowX, flowY;
+        for (int y = 8 + 32; y < 240 - 32; y += 16) {
+            for (int x = 8 + 32; x < 320 - 32; x += 16) {
+                const cv::Point2f& flow = sampler.flowField().at<cv::Point2f>(y, x);
+                flowX.emplace_back(flow.x);
+                flowY.emplace_back(flow.y);
+            }
+        }
+        std::nth_element(flowX.begin(), flowX.begin() + flowX.size()/2, flowX.end());
+        std::nth_element(flowY.begin(), flowY.begin() + flowY.size()/2, flowY.end());
+        EXPECT_NEAR(flowX[flowX.size()/2], -2.0, 0.25);
+        EXPECT_NEAR(flowY[flowY.size()/2], -1.0, 0.25);
+    }
+}
+
+TEST_F(DenseFlowSamplerTest, SphereFlowsMatchLandmarks) {
+    GIFT::DenseFlowSampler sampler = shiftedSampler();
+    ASSERT_TRUE(sampler.processImage(frames[2]));
+    const auto& flows = sampler.sphereFlows();
+    ASSERT_EQ(flows.size(), 20u*15u);
+
+    // Samples are kept in grid order, so each can be compared with a landmark moved along the same flow.
+    auto normalised = [&](const cv::Point2f& point) {
+        return cv::Point2f((point.x - K.at<double>(0,2)) / K.at<double>(0,0),
+                           (point.y - K.at<double>(1,2)) / K.at<double>(1,1));
+    };
+    Eigen::Vector3d meanFlow = Eigen::Vector3d::Zero();
+    size_t sample = 0;
+    for (int y = 8; y < 240; y += 16) {
+        for (int x = 8; x < 320; x += 16, ++sample) {
+            const cv::Point2f start(x, y);
+            const cv::Point2f end = start + sampler.flowField().at<cv::Point2f>(y, x);
+            GIFT::Landmark lm(start, normalised(start), 0);
+            lm.update(end, normalised(end));
+
+            const auto& [bearing, sphereFlow] = flows[sample];
+            EXPECT_LT((bearing - lm.sphereCoordinates).norm(), 1e-6);
+            EXPECT_LT((sphereFlow - lm.opticalFlowSphere).norm(), 1e-6);
+            meanFlow += sphereFlow;
+        }
+    }
+
+    // Near the optical axis, the flow on the sphere is the pixel flow divided by the focal length.
+    meanFlow /= flows.size();
+    EXPECT_NEAR(meanFlow.x(), -2.0/500, 0.5/500);
+    EXPECT_NEAR(meanFlow.y(), -1.0/500, 0.5/500);
+    EXPECT_NEAR(meanFlow.z(), 0, 0.5/500);
+}
+
+TEST_F(DenseFlowSamplerTest, MaskedSamplesAreSkipped) {
+    // Only the right half of the image is valid, which keeps 10 of the 20 columns.
+    cv::Mat mask = cv::Mat::zeros(240, 320, CV_8UC1);
+    mask(cv::Rect(160, 0, 160, 240)).setTo(255);
+
+    GIFT::DenseFlowSampler sampler = shiftedSampler();
+    sampler.setMask(mask);
+    ASSERT_TRUE(sampler.processImage(frames[2]));
+    EXPECT_EQ(sampler.sphereFlows().size(), 10u*15u);
+    for (const auto& [bearing, sphereFlow] : sampler.sphereFlows()) EXPECT_GT(bearing.x(), 0);
+
+    // Samples that move out of the valid region are skipped too. Going back to frame 0, the texture moves right
+    // by two pixels, taking the last valid column of samples (at x = 136) out of the mask.
+    mask.setTo(0);
+    mask(cv::Rect(0, 0, 137, 240)).setTo(255);
+    sampler.setMask(mask);
+    ASSERT_TRUE(sampler.processImage(frames[0]));
+    EXPECT_EQ(sampler.sphereFlows().size(), 8u*15u);
+}
+
+TEST_F(DenseFlowSamplerTest, LargeFlowsAreRejected) {
+    // The shift is sqrt(5) pixels.
+    GIFT::DenseFlowSampler sampler = shiftedSampler();
+    sampler.maxFlow = 1.0;
+    ASSERT_TRUE(sampler.processImage(frames[2]));
+    EXPECT_TRUE(sampler.sphereFlows().empty());
+
+    sampler.maxFlow = 3.0;
+    ASSERT_TRUE(sampler.processImage(frames[0]));
+    EXPECT_EQ(sampler.sphereFlows().size(), 20u*15u);
+}
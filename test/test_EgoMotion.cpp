@@ -17,6 +17,8 @@
 
 #include "gtest/gtest.h"
 #include "EgoMotion.h"
+#include "FlowCoreset.h"
+#include <set>
 
 using namespace Eigen;
 using namespace std;
@@ -129,4 +131,202 @@ TEST_F(EgoMotionTest, ConvergesAngVelFromLinVel) {
         EXPECT_LE((estAngVel - trueAngVel).norm(), 1e-2);
         EXPECT_LE(pow(estLinVel.dot(trueLinVel),2) - 1, 1e-2);
     }
-}
\ No newline at end of file
+}
+
+TEST_F(EgoMotionTest, GyroAidedRecoversLinVel) {
+    int testCount = 20;
+    for (int i = 0; i < testCount; ++i) {
+        // Include very slow translation, where the full optimisation struggles to separate the motions.
+        Vector3d trueLinVel = (Vector3d::Random()).normalized() * ((i % 2 == 0) ? 1.0 : 1e-3);
+        Vector3d trueAngVel = Vector3d::Random()*4;
+
+        vector<pair<Vector3d, Vector3d>> sphereFlows;
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            Vector3d phi = etaRho.second * (Matrix3d::Identity() - etaRho.first*etaRho.first.transpose()) * trueLinVel - trueAngVel.cross(etaRho.first);
+            sphereFlows.emplace_back(make_pair(etaRho.first, phi));
+        }
+
+        GIFT::EgoMotion egoMotion(sphereFlows, GIFT::GyroMeasurement(trueAngVel));
+        const Vector3d& estLinVel = egoMotion.linearVelocity.normalized();
+
+        EXPECT_LE((egoMotion.angularVelocity - trueAngVel).norm(), 1e-12);
+        EXPECT_GE(fabs(estLinVel.dot(trueLinVel.normalized())), 1 - 1e-6);
+    }
+}
+
+TEST_F(EgoMotionTest, GyroAidedEstimatesBias) {
+    const Vector3d trueBias(0.02, -0.03, 0.01);
+    Vector3d biasEstimate = Vector3d::Zero();
+
+    // The regularised bias estimate is carried from frame to frame, as it would be online.
+    int frameCount = 50;
+    for (int i = 0; i < frameCount; ++i) {
+        Vector3d trueLinVel = (Vector3d::Random()).normalized();
+        Vector3d trueAngVel = Vector3d::Random();
+
+        vector<pair<Vector3d, Vector3d>> sphereFlows;
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            Vector3d phi = etaRho.second * (Matrix3d::Identity() - etaRho.first*etaRho.first.transpose()) * trueLinVel - trueAngVel.cross(etaRho.first);
+            sphereFlows.emplace_back(make_pair(etaRho.first, phi));
+        }
+
+        GIFT::EgoMotion egoMotion(sphereFlows, GIFT::GyroMeasurement(trueAngVel + trueBias, biasEstimate, true));
+        biasEstimate = egoMotion.gyroBias;
+    }
+
+    EXPECT_LE((biasEstimate - trueBias).norm(), 1e-3);
+}
+
+TEST_F(EgoMotionTest, MultiStartConvergesFromColdStart) {
+    int testCount = 20;
+    for (int i = 0; i < testCount; ++i) {
+        Vector3d trueLinVel = (Vector3d::Random()).normalized();
+        Vector3d trueAngVel = Vector3d::Random()*4;
+
+        vector<pair<Vector3d, Vector3d>> sphereFlows;
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            Vector3d phi = etaRho.second * (Matrix3d::Identity() - etaRho.first*etaRho.first.transpose()) * trueLinVel - trueAngVel.cross(etaRho.first);
+            sphereFlows.emplace_back(make_pair(etaRho.first, phi));
+        }
+
+        // No initial velocity is given, and the starts are solved both in parallel and in turn.
+        for (int threads : {4, 1}) {
+            GIFT::MultiStartOptions options;
+            options.threads = threads;
+            GIFT::EgoMotion egoMotion(sphereFlows, options);
+            const Vector3d& estLinVel = egoMotion.linearVelocity.normalized();
+            const Vector3d& estAngVel = egoMotion.angularVelocity;
+
+            EXPECT_LE((estAngVel - trueAngVel).norm(), 1e-2);
+            EXPECT_GE(fabs(estLinVel.dot(trueLinVel)), 1 - 1e-4);
+            EXPECT_LE(egoMotion.optimisedResidual, 1e-8);
+        }
+    }
+}
+
+TEST_F(EgoMotionTest, RotationOnlySkipsOptimisation) {
+    int testCount = 20;
+    for (int i = 0; i < testCount; ++i) {
+        Vector3d trueAngVel = Vector3d::Random()*4;
+
+        vector<pair<Vector3d, Vector3d>> rotationFlows;
+        vector<pair<Vector3d, Vector3d>> translationFlows;
+        const Vector3d trueLinVel = (Vector3d::Random()).normalized();
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            const Vector3d& eta = etaRho.first;
+            rotationFlows.emplace_back(make_pair(eta, -trueAngVel.cross(eta)));
+            Vector3d phi = etaRho.second * (Matrix3d::Identity() - eta*eta.transpose()) * trueLinVel - trueAngVel.cross(eta);
+            translationFlows.emplace_back(make_pair(eta, phi));
+        }
+
+        // The rotation is returned without iterating, and the initial linear velocity is kept. The flow is
+        // noise-free, so only the exact rotation should count as one.
+        GIFT::EgoMotionOptions noiseFree;
+        noiseFree.rotationOnlyThreshold = 1e-8;
+        const Vector3d initialLinVel = (Vector3d::Random()).normalized();
+        GIFT::EgoMotion rotationOnly(rotationFlows, initialLinVel, noiseFree);
+        EXPECT_FALSE(rotationOnly.translationObservable);
+        EXPECT_EQ(rotationOnly.optimisationSteps, 0);
+        EXPECT_LE((rotationOnly.angularVelocity - trueAngVel).norm(), 1e-9);
+        EXPECT_EQ(rotationOnly.linearVelocity, initialLinVel);
+
+        GIFT::EgoMotion withTranslation(translationFlows, initialLinVel, noiseFree);
+        EXPECT_TRUE(withTranslation.translationObservable);
+        EXPECT_GT(withTranslation.optimisationSteps, 0);
+    }
+}
+
+TEST_F(EgoMotionTest, NoisyRotationIsRecognisedWithThreshold) {
+    int testCount = 20;
+    for (int i = 0; i < testCount; ++i) {
+        const Vector3d trueAngVel = (Vector3d::Random()).normalized();
+        const Vector3d trueLinVel = (Vector3d::Random()).normalized();
+
+        // Tracking noise of about 1% of the flow, on top of a slight translation whose parallax is far smaller,
+        // and of a translation past nearby points whose parallax is far larger.
+        vector<pair<Vector3d, Vector3d>> nearRotationFlows;
+        vector<pair<Vector3d, Vector3d>> translationFlows;
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            const Vector3d& eta = etaRho.first;
+            const Matrix3d tangent = Matrix3d::Identity() - eta*eta.transpose();
+            const Vector3d noise = tangent * Vector3d::Random() * 0.015;
+            const Vector3d rotation = -trueAngVel.cross(eta);
+            nearRotationFlows.emplace_back(make_pair(eta, rotation + etaRho.second * tangent * trueLinVel * 0.05 + noise));
+            translationFlows.emplace_back(make_pair(eta, rotation + 10 * etaRho.second * tangent * trueLinVel + noise));
+        }
+
+        GIFT::EgoMotionOptions noisy;
+        noisy.rotationOnlyThreshold = 1e-3;
+        const Vector3d initialLinVel(0,0,1);
+        GIFT::EgoMotion nearRotation(nearRotationFlows, initialLinVel, noisy);
+        EXPECT_FALSE(nearRotation.translationObservable);
+        EXPECT_EQ(nearRotation.optimisationSteps, 0);
+        EXPECT_LE((nearRotation.angularVelocity - trueAngVel).norm(), 1e-2);
+        EXPECT_EQ(nearRotation.linearVelocity, initialLinVel);
+
+        GIFT::EgoMotion withTranslation(translationFlows, initialLinVel, noisy);
+        EXPECT_TRUE(withTranslation.translationObservable);
+        EXPECT_GT(withTranslation.optimisationSteps, 0);
+    }
+}
+
+TEST_F(EgoMotionTest, RotationOnlyCheckIsOffByDefault) {
+    int testCount = 20;
+    for (int i = 0; i < testCount; ++i) {
+        Vector3d trueLinVel = (Vector3d::Random()).normalized();
+        Vector3d trueAngVel = Vector3d::Random()*4;
+
+        vector<pair<Vector3d, Vector3d>> sphereFlows;
+        for (const auto& etaRho: bearingsAndInvDepths) {
+            Vector3d phi = etaRho.second * (Matrix3d::Identity() - etaRho.first*etaRho.first.transpose()) * trueLinVel - trueAngVel.cross(etaRho.first);
+            sphereFlows.emplace_back(make_pair(etaRho.first, phi));
+        }
+        Vector3d initialLinVel = (trueLinVel + i*trueLinVel.norm()*Vector3d::Random()/testCount).normalized();
+        Vector3d initialAngVel = trueAngVel + trueAngVel.norm()*i*Vector3d::Random()/testCount;
+
+        // The parallax of this flow is small next to its rotation, but every constructor still optimises.
+        const GIFT::EgoMotion solves[] = {
+            GIFT::EgoMotion(sphereFlows),
+            GIFT::EgoMotion(sphereFlows, initialLinVel),
+            GIFT::EgoMotion(sphereFlows, initialLinVel, initialAngVel),
+        };
+        for (const GIFT::EgoMotion& egoMotion : solves) {
+            EXPECT_TRUE(egoMotion.translationObservable);
+            EXPECT_GT(egoMotion.optimisationSteps, 0);
+            EXPECT_LE((egoMotion.angularVelocity - trueAngVel).norm(), 1e-4);
+        }
+    }
+}
+
+TEST(FlowCoresetTest, SelectsSpreadSubsetOfClusteredFlows) {
+    // Most points are clustered in a narrow cone, the rest are spread over the sphere.
+    vector<pair<Vector3d, double>> bearingsAndInvDepths;
+    for (int i = 0; i < 2000; ++i) {
+        Vector3d eta = (i < 1800) ? (Vector3d(0,0,1) + 0.05*Vector3d::Random()).normalized() : Vector3d(Vector3d::Random().normalized());
+        bearingsAndInvDepths.emplace_back(eta, 0.01 + 0.1*fabs(Vector3d::Random().x()));
+    }
+
+    const Vector3d trueLinVel = Vector3d(1,0.5,-0.2).normalized();
+    const Vector3d trueAngVel(0.3,-0.2,0.5);
+    vector<pair<Vector3d, Vector3d>> sphereFlows;
+    for (const auto& etaRho: bearingsAndInvDepths) {
+        Vector3d phi = etaRho.second * (Matrix3d::Identity() - etaRho.first*etaRho.first.transpose()) * trueLinVel - trueAngVel.cross(etaRho.first);
+        sphereFlows.emplace_back(make_pair(etaRho.first, phi));
+    }
+
+    GIFT::FlowCoreset coreset;
+    coreset.maxFlows = 150;
+    const vector<pair<Vector3d, Vector3d>>& selectedFlows = coreset.select(sphereFlows);
+    ASSERT_EQ(selectedFlows.size(), 150);
+
+    // There are fewer occupied bins than flows to select, so every occupied bin is represented.
+    set<int> occupiedBins, selectedBins;
+    for (const auto& flow : sphereFlows) occupiedBins.insert(coreset.binOf(flow.first));
+    for (const auto& flow : selectedFlows) selectedBins.insert(coreset.binOf(flow.first));
+    ASSERT_LT(occupiedBins.size(), 150);
+    EXPECT_EQ(selectedBins, occupiedBins);
+
+    GIFT::EgoMotion egoMotion(selectedFlows, trueLinVel, Vector3d::Zero());
+    EXPECT_LE((egoMotion.angularVelocity - trueAngVel).norm(), 1e-2);
+    EXPECT_LE(1 - pow(egoMotion.linearVelocity.normalized().dot(trueLinVel),2), 1e-2);
+}
@@ -0,0 +1,330 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "FeatureTracker.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "SlidingTexture.h"
+#include <algorithm>
+#include <map>
+#include <vector>
+
+class FeatureTrackerTest : public ::testing::Test {
+protected:
+    static constexpr int frameCount = 30;
+    std::vector<cv::Mat> frames = slidingTextureFrames(frameCount);
+};
+
+TEST_F(FeatureTrackerTest, StatsAccountForEveryLandmark) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+
+    for (int i = 0; i < frameCount; ++i) {
+        if (i == frameCount/2) ft.maxFeatures = 60;
+        ft.processImage(frames[i]);
+
+        const GIFT::TrackerStats& frame = ft.frameStats();
+        EXPECT_EQ(frame.candidates, frame.rejectedDuplicate + frame.rejectedCap + frame.births);
+        int histogramCount = 0;
+        for (int count : frame.lifetimeHistogram) histogramCount += count;
+        EXPECT_EQ(histogramCount, frame.deaths());
+        int coverageCount = 0;
+        for (int count : frame.coverage) coverageCount += count;
+        EXPECT_EQ(coverageCount, (int)ft.outputLandmarks().size());
+    }
+
+    // Every landmark alive now was born and has not died.
+    const GIFT::TrackerStats& total = ft.totalStats();
+    EXPECT_EQ(total.frames, frameCount);
+    EXPECT_EQ(total.births - total.deaths(), (int)ft.outputLandmarks().size());
+    EXPECT_GT(total.lostBudget, 0);
+    EXPECT_GE(total.meanTrackingError(), 0.0);
+}
+
+TEST_F(FeatureTrackerTest, HeldSnapshotsAreNotModified) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+
+    for (int i = 0; i < 5; ++i) ft.processImage(frames[i]);
+    const std::shared_ptr<const GIFT::LandmarkSnapshot> held = ft.latestSnapshot();
+    const std::vector<GIFT::Landmark> heldLandmarks = held->landmarks;
+    ASSERT_FALSE(heldLandmarks.empty());
+
+    // The tracker builds each frame in a recycled snapshot, which must never be the one held here.
+    for (int i = 5; i < frameCount; ++i) {
+        if (i == frameCount/2) ft.maxFeatures = 60;
+        ft.processImage(frames[i]);
+        const std::shared_ptr<const GIFT::LandmarkSnapshot> latest = ft.latestSnapshot();
+        EXPECT_EQ(latest->frameNumber, i + 1);
+        EXPECT_EQ(latest->landmarks.size(), ft.outputLandmarks().size());
+    }
+    EXPECT_EQ(held->frameNumber, 5);
+    ASSERT_EQ(held->landmarks.size(), heldLandmarks.size());
+    for (size_t i = 0; i < heldLandmarks.size(); ++i) {
+        EXPECT_EQ(held->landmarks[i].idNumber, heldLandmarks[i].idNumber);
+        EXPECT_EQ(held->landmarks[i].camCoordinates, heldLandmarks[i].camCoordinates);
+        EXPECT_EQ(held->landmarks[i].lifetime, heldLandmarks[i].lifetime);
+    }
+}
+
+TEST_F(FeatureTrackerTest, UnselectedLandmarkFieldsAreNotUpdated) {
+    GIFT::FeatureTracker full;
+    full.maxFeatures = 100;
+    full.featureDist = 10;
+    GIFT::FeatureTracker sphereOnly = full;
+    sphereOnly.landmarkFields = GIFT::LandmarkFields::FlowSphere;
+
+    std::map<int, cv::Point2f> birthPositions;
+    for (int i = 0; i < frameCount; ++i) {
+        full.processImage(frames[i]);
+        sphereOnly.processImage(frames[i]);
+
+        const std::vector<GIFT::Landmark>& expected = full.outputLandmarks();
+        const std::vector<GIFT::Landmark>& landmarks = sphereOnly.outputLandmarks();
+        ASSERT_EQ(landmarks.size(), expected.size());
+        for (size_t j = 0; j < landmarks.size(); ++j) {
+            const GIFT::Landmark& lm = landmarks[j];
+            ASSERT_EQ(lm.idNumber, expected[j].idNumber);
+            EXPECT_EQ(lm.camCoordinates, expected[j].camCoordinates);
+            EXPECT_EQ(lm.lifetime, expected[j].lifetime);
+            EXPECT_EQ(lm.sphereCoordinates, expected[j].sphereCoordinates);
+            EXPECT_EQ(lm.opticalFlowSphere, expected[j].opticalFlowSphere);
+
+            // The other fields keep the values the landmark was created with.
+            const cv::Point2f birthPosition = birthPositions.emplace(lm.idNumber, lm.camCoordinates).first->second;
+            EXPECT_EQ(lm.keypoint.pt, birthPosition);
+            EXPECT_TRUE(lm.opticalFlowRaw.isZero());
+            EXPECT_TRUE(lm.opticalFlowNorm.isZero());
+            EXPECT_EQ(lm.pointColor, (colorVec{0,0,0}));
+        }
+    }
+    // Make sure the flows were actually compared on tracked landmarks.
+    ASSERT_FALSE(full.outputLandmarks().empty());
+    EXPECT_GT(full.outputLandmarks().front().lifetime, 1);
+    EXPECT_FALSE(full.outputLandmarks().front().opticalFlowSphere.isZero());
+}
+
+TEST_F(FeatureTrackerTest, TrackHistoryFollowsLandmarks) {
+    constexpr int historyLength = 5;
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.historyLength = historyLength;
+
+    for (int i = 0; i < frameCount; ++i) {
+        ft.processImage(frames[i]);
+
+        const GIFT::TrackHistory& history = ft.trackHistory();
+        std::vector<bool> slotUsed(history.slotCount(), false);
+        for (const auto& lm : ft.outputLandmarks()) {
+            ASSERT_GE(lm.historySlot, 0);
+            ASSERT_LT(lm.historySlot, history.slotCount());
+            EXPECT_FALSE(slotUsed[lm.historySlot]);
+            slotUsed[lm.historySlot] = true;
+
+            EXPECT_EQ(history.size(lm.historySlot), std::min(lm.lifetime, historyLength));
+            EXPECT_EQ(history.position(lm.historySlot, 0), lm.camCoordinates);
+            if (lm.lifetime > 1) {
+                const cv::Point2f previous = lm.camCoordinates - cv::Point2f(lm.opticalFlowRaw.x(), lm.opticalFlowRaw.y());
+                EXPECT_LT(cv::norm(history.position(lm.historySlot, 1) - previous), 1e-3);
+            }
+        }
+    }
+}
+
+TEST_F(FeatureTrackerTest, LandmarksStayInRegionsOfInterest) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    const std::vector<cv::Rect> regions = {cv::Rect(20, 30, 100, 80), cv::Rect(180, 120, 120, 100)};
+    ft.setRegionsOfInterest(regions);
+    auto inside = [](const cv::Rect& r, const cv::Point2f& p) {
+        return p.x >= r.x && p.y >= r.y && p.x < r.x + r.width && p.y < r.y + r.height;
+    };
+
+    for (int i = 0; i < frameCount; ++i) {
+        ft.processImage(frames[i]);
+        ASSERT_FALSE(ft.outputLandmarks().empty());
+
+        int landmarksInFirstRegion = 0;
+        for (const auto& lm : ft.outputLandmarks()) {
+            const bool inFirst = inside(regions[0], lm.camCoordinates);
+            EXPECT_TRUE(inFirst || inside(regions[1], lm.camCoordinates));
+            landmarksInFirstRegion += inFirst;
+        }
+        // Both regions are searched, in full image coordinates.
+        EXPECT_GT(landmarksInFirstRegion, 0);
+        EXPECT_LT(landmarksInFirstRegion, (int)ft.outputLandmarks().size());
+    }
+}
+
+TEST_F(FeatureTrackerTest, ScaledTrackingReportsFullResolutionFlow) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 20;
+    ft.processingScale = 0.5;
+    ft.refineAtFullResolution = true;
+
+    for (int i = 0; i < frameCount; ++i) {
+        ft.processImage(frames[i]);
+        if (i == 0) continue;
+
+        // The window slides one pixel right per frame, so the texture moves one pixel left.
+        double flowX = 0;
+        int tracked = 0;
+        for (const auto& lm : ft.outputLandmarks()) {
+            EXPECT_GE(lm.camCoordinates.x, 0);
+            EXPECT_LT(lm.camCoordinates.x, frames[i].cols);
+            EXPECT_GE(lm.camCoordinates.y, 0);
+            EXPECT_LT(lm.camCoordinates.y, frames[i].rows);
+            if (lm.lifetime < 2) continue;
+            flowX += lm.opticalFlowRaw.x();
+            ++tracked;
+        }
+        ASSERT_GT(tracked, 0);
+        EXPECT_NEAR(flowX / tracked, -1.0, 0.1);
+    }
+}
+
+TEST_F(FeatureTrackerTest, StaticFramesAreDecimated) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.decimateStaticFrames = true;
+    ft.maxDecimatedFrames = 3;
+    ft.staticChangeThreshold = 0.5; // The texture is smooth, so a one pixel shift changes it little
+    constexpr double dt = 0.05;
+
+    ft.processImage(frames[0], dt);
+    ft.processImage(frames[1], dt);
+    ASSERT_FALSE(ft.frameDecimated());
+    ASSERT_GT(ft.outputLandmarks().size(), ft.featureSearchThreshold*ft.maxFeatures);
+
+    // Repeating the last frame only skips up to maxDecimatedFrames in a row.
+    for (int i = 1; i <= ft.maxDecimatedFrames; ++i) {
+        ft.processImage(frames[1], dt);
+        EXPECT_TRUE(ft.frameDecimated());
+        EXPECT_EQ(ft.decimationDecision().decimatedFrames, i);
+        EXPECT_NEAR(ft.flowInterval(), (i+1)*dt, 1e-9);
+        for (const auto& lm : ft.outputLandmarks()) EXPECT_EQ(lm.opticalFlowRaw.norm(), 0);
+    }
+    ft.processImage(frames[1], dt);
+    EXPECT_FALSE(ft.frameDecimated());
+    EXPECT_NEAR(ft.flowInterval(), (ft.maxDecimatedFrames+1)*dt, 1e-9);
+    EXPECT_EQ(ft.totalStats().decimatedFrames, ft.maxDecimatedFrames);
+
+    // A moving image is always tracked.
+    for (int i = 2; i < frameCount; ++i) {
+        ft.processImage(frames[i], dt);
+        EXPECT_FALSE(ft.frameDecimated());
+        EXPECT_NEAR(ft.flowInterval(), dt, 1e-9);
+    }
+}
+
+TEST_F(FeatureTrackerTest, PredictionsSeedTheTracking) {
+    // Every second frame the texture moves by (-2,-1). With this camera, a small rotation about the y and x axes
+    // moves the image centre by the same amount.
+    cv::Mat K = cv::Mat::eye(3, 3, CV_64F);
+    K.at<double>(0,0) = 500;
+    K.at<double>(1,1) = 500;
+    K.at<double>(0,2) = 160;
+    K.at<double>(1,2) = 120;
+    const GIFT::CameraParameters camera(K);
+    GIFT::FeatureTracker ft(camera);
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.featureSearchThreshold = 0.5;
+    const Eigen::Vector3d angularVelocity(-1.0/500, 2.0/500, 0);
+
+    auto expectShiftTracked = [&](int frame) {
+        ft.processImage(frames[frame]);
+        int tracked = 0;
+        for (const auto& lm : ft.outputLandmarks()) {
+            if (lm.lifetime < 2) continue;
+            EXPECT_NEAR(lm.opticalFlowRaw.x(), -2.0, 0.1);
+            EXPECT_NEAR(lm.opticalFlowRaw.y(), -1.0, 0.1);
+            ++tracked;
+        }
+        EXPECT_GT(tracked, 0.8*ft.maxFeatures);
+    };
+    ft.processImage(frames[0]);
+
+    // A rotation rate ignores translation, so by default it only seeds the full search.
+    ft.predictFromAngularVelocity(angularVelocity);
+    expectShiftTracked(2);
+    EXPECT_EQ(ft.lastTrackingWindow(), ft.trackingWindow);
+    EXPECT_EQ(ft.lastTrackingPyramidLevels(), ft.trackingPyramidLevels);
+
+    ft.predictFromAngularVelocity(angularVelocity, 1.0, true);
+    expectShiftTracked(4);
+    EXPECT_EQ(ft.lastTrackingWindow(), ft.predictedTrackingWindow);
+    EXPECT_EQ(ft.lastTrackingPyramidLevels(), ft.predictedTrackingPyramidLevels);
+
+    // The shift is explained by a rotation, so the ego-motion prediction has a small residual and is reliable.
+    GIFT::EgoMotionOptions rotationOnly;
+    rotationOnly.rotationOnlyThreshold = 1;
+    const GIFT::EgoMotion egoMotion(ft.outputLandmarks(), Eigen::Vector3d(0,0,1), 1.0, rotationOnly);
+    ASSERT_LT(egoMotion.optimisedResidual, ft.predictionResidualThreshold);
+    ft.predictFromEgoMotion(egoMotion);
+    expectShiftTracked(6);
+    EXPECT_EQ(ft.lastTrackingWindow(), ft.predictedTrackingWindow);
+    EXPECT_EQ(ft.lastTrackingPyramidLevels(), ft.predictedTrackingPyramidLevels);
+
+    // A prediction only applies to the next frame.
+    expectShiftTracked(8);
+    EXPECT_EQ(ft.lastTrackingWindow(), ft.trackingWindow);
+}
+
+TEST_F(FeatureTrackerTest, TargetLatencyTunesTheEffort) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    const cv::Size fullWindow = ft.trackingWindow;
+    const int fullLevels = ft.trackingPyramidLevels;
+
+    // No frame can meet this target, so the effort is cut down to the cheapest step of both ladders.
+    ft.setTargetLatency(1e-9);
+    for (int i = 0; i < frameCount; ++i) {
+        ft.processImage(frames[i]);
+        EXPECT_GT(ft.lastStageTimes().total, 0);
+        if (i == 0) ft.maxFeatures = 1000; // Overwritten by the budget after the next frame
+    }
+    const GIFT::BudgetDecision decision = ft.budgetDecision();
+    EXPECT_EQ(decision.frameNumber, frameCount);
+    EXPECT_EQ(decision.trackingLevel, 5);
+    EXPECT_EQ(decision.detectionLevel, 3);
+    EXPECT_EQ(ft.maxFeatures, 100/3);
+    EXPECT_EQ(ft.trackingPyramidLevels, 1);
+    EXPECT_LT(ft.trackingWindow.width, fullWindow.width);
+    EXPECT_LT(ft.trackingWindow.height, fullWindow.height);
+    EXPECT_LT(ft.featureSearchThreshold, 1.0);
+    EXPECT_LT(ft.detectionCoverage, 1.0);
+    EXPECT_LE(ft.outputLandmarks().size(), 100u);
+
+    // Clearing the target restores the effort it started from.
+    ft.clearTargetLatency();
+    EXPECT_EQ(ft.maxFeatures, 100);
+    EXPECT_EQ(ft.trackingPyramidLevels, fullLevels);
+    EXPECT_EQ(ft.trackingWindow.width, fullWindow.width);
+    EXPECT_EQ(ft.trackingWindow.height, fullWindow.height);
+    EXPECT_EQ(ft.featureSearchThreshold, 1.0);
+    EXPECT_EQ(ft.detectionCoverage, 1.0);
+    ft.processImage(frames[0]);
+    EXPECT_EQ(ft.maxFeatures, 100);
+}
@@ -0,0 +1,123 @@
+/*
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "FeatureTracker.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/video/tracking.hpp"
+#include "opencv2/calib3d/calib3d.hpp"
+#include "SlidingTexture.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Counting allocator: counts the allocations made by the calling thread while counting is enabled.
+static thread_local bool countAllocations = false;
+static thread_local size_t allocationCount = 0;
+
+void* operator new(std::size_t size) {
+    if (countAllocations) ++allocationCount;
+    void* ptr = std::malloc(size == 0 ? 1 : size);
+    if (!ptr) throw std::bad_alloc();
+    return ptr;
+}
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+
+template<typename Function>
+size_t countAllocationsIn(Function function) {
+    allocationCount = 0;
+    countAllocations = true;
+    function();
+    countAllocations = false;
+    return allocationCount;
+}
+
+class FeatureTrackerAllocationTest : public ::testing::Test {
+protected:
+    // Checks that after warm-up, processImage allocates no more than the OpenCV calls it makes on the same data.
+    void expectSteadyStateDoesNotAllocate(GIFT::FeatureTracker& ft, bool detects) {
+        cv::setNumThreads(0);
+
+        for (int i = 0; i < warmUpFrames; ++i) ft.processImage(frames[i]);
+        ASSERT_GT(ft.outputLandmarks().size(), 0.5*ft.maxFeatures);
+
+        // The same OpenCV calls with warmed-up outputs give the allocations made inside OpenCV itself.
+        std::vector<cv::Point2f> points, trackedPoints, trackedPointsNorm, corners, cornersNorm;
+        std::vector<uchar> status;
+        std::vector<float> error;
+        for (const auto& lm : ft.outputLandmarks()) points.emplace_back(lm.camCoordinates);
+        std::vector<cv::Mat> greyFrames(frameCount);
+        for (int i = 0; i < frameCount; ++i) cv::cvtColor(frames[i], greyFrames[i], cv::COLOR_BGR2GRAY);
+        const cv::Mat K = cv::Mat::eye(3,3,CV_64F);
+        const std::vector<double> distortion = {0,0,0,0};
+        auto referenceFrame = [&](int i) {
+            cv::calcOpticalFlowPyrLK(frames[i-1], frames[i], points, trackedPoints, status, error);
+            cv::undistortPoints(trackedPoints, trackedPointsNorm, K, distortion);
+            if (!detects) return;
+            cv::goodFeaturesToTrack(greyFrames[i], corners, ft.maxFeatures, ft.minHarrisQuality, ft.featureDist);
+            cv::undistortPoints(corners, cornersNorm, K, distortion);
+        };
+        referenceFrame(warmUpFrames);
+
+        for (int i = warmUpFrames; i < frameCount; ++i) {
+            size_t referenceAllocations = countAllocationsIn([&]() { referenceFrame(i); });
+            size_t trackerAllocations = countAllocationsIn([&]() { ft.processImage(frames[i]); });
+            ASSERT_GT(ft.outputLandmarks().size(), 0.5*ft.maxFeatures);
+            if (detects) ASSERT_GT(ft.frameStats().candidates, 0) << "Frame " << i;
+            else ASSERT_EQ(ft.frameStats().candidates, 0) << "Frame " << i;
+
+            EXPECT_LE(trackerAllocations, referenceAllocations) << "Frame " << i;
+        }
+    }
+
+    static constexpr int frameCount = 30;
+    static constexpr int warmUpFrames = 10;
+    std::vector<cv::Mat> frames = slidingTextureFrames(frameCount);
+};
+
+TEST_F(FeatureTrackerAllocationTest, SteadyStateProcessImageDoesNotAllocate) {
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.featureSearchThreshold = 0.5;
+
+    expectSteadyStateDoesNotAllocate(ft, false);
+}
+
+TEST_F(FeatureTrackerAllocationTest, SteadyStateRedetectionDoesNotAllocate) {
+    // With the threshold at one, new features are detected and added on every frame.
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.featureSearchThreshold = 1.0;
+
+    expectSteadyStateDoesNotAllocate(ft, true);
+}
+
+TEST_F(FeatureTrackerAllocationTest, SteadyStateHistoryDoesNotAllocate) {
+    // Tracks are born and die on every frame, so history slots are released and reused.
+    GIFT::FeatureTracker ft;
+    ft.maxFeatures = 100;
+    ft.featureDist = 10;
+    ft.featureSearchThreshold = 1.0;
+    ft.historyLength = 5;
+
+    expectSteadyStateDoesNotAllocate(ft, true);
+    ASSERT_TRUE(ft.trackHistory().enabled());
+    for (const auto& lm : ft.outputLandmarks()) EXPECT_GE(lm.historySlot, 0);
+}
@@ -0,0 +1,135 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "FrameSource.h"
+#include <chrono>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+// Produces frameCount 1x1 frames holding their index.
+class CountingFrameSource : public GIFT::FrameSource {
+public:
+    CountingFrameSource(int frameCount, bool live, std::shared_ptr<std::atomic<int>> framesRead)
+        : frameCount(frameCount), live(live), framesRead(framesRead) {};
+    bool read(cv::Mat& image) override {
+        if (nextFrame >= frameCount) return false;
+        image.create(1, 1, CV_32SC1);
+        image.at<int>(0,0) = nextFrame++;
+        ++*framesRead;
+        return true;
+    };
+    bool isLive() const override { return live; };
+
+protected:
+    int frameCount;
+    int nextFrame = 0;
+    bool live;
+    std::shared_ptr<std::atomic<int>> framesRead;
+};
+
+class PrefetchingFrameSourceTest : public ::testing::Test {
+protected:
+    std::unique_ptr<GIFT::PrefetchingFrameSource> makeSource(bool live, GIFT::FrameDropPolicy dropPolicy) {
+        return std::make_unique<GIFT::PrefetchingFrameSource>(
+            std::make_unique<CountingFrameSource>(frameCount, live, framesRead), bufferCount, dropPolicy);
+    }
+
+    // Waits until the decoder has stopped reading from the source.
+    void waitForDecoder() {
+        int previous = -1;
+        while (framesRead->load() != previous) {
+            previous = framesRead->load();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    }
+
+    static constexpr int frameCount = 50;
+    static constexpr int bufferCount = 4;
+    std::shared_ptr<std::atomic<int>> framesRead = std::make_shared<std::atomic<int>>(0);
+};
+
+TEST_F(PrefetchingFrameSourceTest, DeliversEveryFrameInOrder) {
+    auto source = makeSource(false, GIFT::FrameDropPolicy::Block);
+    cv::Mat image;
+    for (int i = 0; i < frameCount; ++i) {
+        ASSERT_TRUE(source->read(image));
+        EXPECT_EQ(image.at<int>(0,0), i);
+        // Let the decoder fill the ring now and then.
+        if (i % 10 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_FALSE(source->read(image));
+    EXPECT_EQ(source->droppedFrames(), 0u);
+}
+
+TEST_F(PrefetchingFrameSourceTest, BlockStopsDecodingWhenTheRingIsFull) {
+    auto source = makeSource(false, GIFT::FrameDropPolicy::Block);
+    waitForDecoder();
+    // One buffer is kept for the reader.
+    EXPECT_EQ(framesRead->load(), bufferCount - 1);
+
+    cv::Mat image;
+    for (int i = 0; i < frameCount; ++i) {
+        ASSERT_TRUE(source->read(image));
+        EXPECT_EQ(image.at<int>(0,0), i);
+    }
+    EXPECT_FALSE(source->read(image));
+    EXPECT_EQ(source->droppedFrames(), 0u);
+}
+
+TEST_F(PrefetchingFrameSourceTest, DropOldestKeepsTheNewestFrames) {
+    auto source = makeSource(false, GIFT::FrameDropPolicy::DropOldest);
+    waitForDecoder();
+    EXPECT_EQ(framesRead->load(), frameCount);
+
+    cv::Mat image;
+    int delivered = 0;
+    int last = -1;
+    while (source->read(image)) {
+        EXPECT_GT(image.at<int>(0,0), last);
+        last = image.at<int>(0,0);
+        ++delivered;
+    }
+    EXPECT_EQ(last, frameCount - 1);
+    EXPECT_LE(delivered, bufferCount - 1);
+    EXPECT_EQ(delivered + (int)source->droppedFrames(), frameCount);
+}
+
+TEST_F(PrefetchingFrameSourceTest, AutomaticDropsOnlyForLiveSources) {
+    auto recorded = makeSource(false, GIFT::FrameDropPolicy::Automatic);
+    waitForDecoder();
+    EXPECT_EQ(framesRead->load(), bufferCount - 1);
+    EXPECT_EQ(recorded->droppedFrames(), 0u);
+
+    framesRead->store(0);
+    auto live = makeSource(true, GIFT::FrameDropPolicy::Automatic);
+    waitForDecoder();
+    EXPECT_EQ(framesRead->load(), frameCount);
+    EXPECT_EQ(live->droppedFrames(), (uint64_t)(frameCount - (bufferCount - 1)));
+}
+
+TEST_F(PrefetchingFrameSourceTest, EndOfStream) {
+    auto empty = std::make_unique<GIFT::PrefetchingFrameSource>(
+        std::make_unique<CountingFrameSource>(0, false, framesRead), bufferCount);
+    cv::Mat image;
+    EXPECT_FALSE(empty->read(image));
+    EXPECT_FALSE(empty->read(image));
+
+    EXPECT_THROW(GIFT::PrefetchingFrameSource(std::make_unique<CountingFrameSource>(1, false, framesRead), 2),
+                 std::invalid_argument);
+}
@@ -0,0 +1,126 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "PyramidalLK.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/video/tracking.hpp"
+#include <vector>
+
+// This file is built once with the library's default kernels and, where the compiler supports it, once more
+// with AVX2, so both the scalar (or NEON) and the AVX2 loops are compared against OpenCV.
+class PyramidalLKTest : public ::testing::Test {
+protected:
+    PyramidalLKTest() {
+        cv::Mat texture(240, 320, CV_8UC1);
+        cv::randu(texture, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::GaussianBlur(texture, previousImage, cv::Size(9,9), 2.5);
+        cv::Mat shift = cv::Mat::eye(2, 3, CV_64F);
+        shift.at<double>(0,2) = trueShift.x;
+        shift.at<double>(1,2) = trueShift.y;
+        cv::warpAffine(previousImage, nextImage, shift, previousImage.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
+    }
+
+    void SetUp() override {
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+        if (!__builtin_cpu_supports("avx2")) GTEST_SKIP() << "This CPU does not support AVX2.";
+#endif
+    }
+
+    // Tracks the points with both implementations from the same initial positions.
+    void trackBoth(const std::vector<cv::Point2f>& points, const std::vector<cv::Point2f>& initial, int window) {
+        ourNext = initial;
+        opencvNext = initial;
+        GIFT::PyramidalLK lk;
+        lk.setImage(previousImage, pyramidLevels);
+        lk.setImage(nextImage, pyramidLevels);
+        lk.track(points, ourNext, ourStatus, ourError, cv::Size(window, window), pyramidLevels, true);
+
+        cv::calcOpticalFlowPyrLK(previousImage, nextImage, points, opencvNext, opencvStatus, opencvError,
+                                 cv::Size(window, window), pyramidLevels,
+                                 cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, lk.maxIterations, lk.epsilon),
+                                 cv::OPTFLOW_USE_INITIAL_FLOW, lk.minEigThreshold);
+    }
+
+    const cv::Point2f trueShift = cv::Point2f(1.3f, -0.7f);
+    static constexpr int pyramidLevels = 3;
+    cv::Mat previousImage;
+    cv::Mat nextImage;
+
+    std::vector<cv::Point2f> ourNext, opencvNext;
+    std::vector<uchar> ourStatus, opencvStatus;
+    std::vector<float> ourError, opencvError;
+};
+
+TEST_F(PyramidalLKTest, MatchesOpenCVForEveryWindowSize) {
+    const int cols = previousImage.cols;
+    const int rows = previousImage.rows;
+    for (int window = 7; window <= 21; window += 2) {
+        const float margin = window/2 + 2;
+
+        // Interior points, and points whose window is inside the image but whose padded loads reach
+        // into the 48 pixel reflected border of the pyramid levels.
+        std::vector<cv::Point2f> points;
+        for (float y = 60.25f; y < rows - 60; y += 30) {
+            for (float x = 60.75f; x < cols - 60; x += 30) points.emplace_back(x, y);
+        }
+        for (float t = 60.5f; t < rows - 60; t += 40) {
+            points.emplace_back(margin, t);
+            points.emplace_back(cols - 1 - margin, t);
+            points.emplace_back(t, margin);
+            points.emplace_back(t, rows - 1 - margin);
+        }
+        trackBoth(points, points, window);
+
+        for (size_t i = 0; i < points.size(); ++i) {
+            ASSERT_TRUE(opencvStatus[i]) << "Window " << window << ", point " << points[i];
+            EXPECT_TRUE(ourStatus[i]) << "Window " << window << ", point " << points[i];
+            EXPECT_LT(cv::norm(ourNext[i] - opencvNext[i]), 0.05) << "Window " << window << ", point " << points[i];
+            EXPECT_LT(cv::norm(ourNext[i] - (points[i] + trueShift)), 0.1) << "Window " << window << ", point " << points[i];
+            EXPECT_NEAR(ourError[i], opencvError[i], 1.0) << "Window " << window << ", point " << points[i];
+        }
+    }
+}
+
+TEST_F(PyramidalLKTest, PointsThatLeaveTheImageAreLost) {
+    const int cols = previousImage.cols;
+    const int rows = previousImage.rows;
+    // Initial guesses far outside the image, beyond the reflected border, and points that start outside it.
+    const std::vector<cv::Point2f> points = {{60.5f, 60.5f}, {cols - 60.5f, rows - 60.5f}, {160.f, 120.f}, {-150.f, 120.f}, {160.f, rows + 150.f}};
+    const std::vector<cv::Point2f> initial = {{-200.f, 60.5f}, {cols + 200.f, rows - 60.5f}, {160.f, -300.f}, {-150.f, 120.f}, {160.f, rows + 150.f}};
+
+    for (int window = 7; window <= 21; window += 2) {
+        trackBoth(points, initial, window);
+        for (size_t i = 0; i < points.size(); ++i) {
+            EXPECT_FALSE(opencvStatus[i]) << "Window " << window << ", point " << i;
+            EXPECT_FALSE(ourStatus[i]) << "Window " << window << ", point " << i;
+        }
+    }
+}
+
+TEST_F(PyramidalLKTest, RejectsUnsupportedWindows) {
+    GIFT::PyramidalLK lk;
+    lk.setImage(previousImage, pyramidLevels);
+    lk.setImage(nextImage, pyramidLevels);
+    std::vector<cv::Point2f> points = {{160.f, 120.f}}, next;
+    std::vector<uchar> status;
+    std::vector<float> error;
+    for (int window : {5, 8, 23}) {
+        EXPECT_THROW(lk.track(points, next, status, error, cv::Size(window, window), pyramidLevels), std::invalid_argument);
+    }
+    EXPECT_THROW(lk.track(points, next, status, error, cv::Size(9, 11), pyramidLevels), std::invalid_argument);
+}
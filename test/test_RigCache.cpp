@@ -0,0 +1,120 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "RigCache.h"
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <unistd.h>
+
+class RigCacheTest : public ::testing::Test {
+protected:
+    RigCacheTest() {
+        const std::string prefix = "test_RigCache_" + std::to_string(getpid());
+        configFiles = {prefix + "_left.yaml", prefix + "_right.yaml"};
+        cacheFile = prefix + ".cache";
+        writeConfig(configFiles[0], 400, 0.0);
+        writeConfig(configFiles[1], 410, 0.1);
+    }
+    ~RigCacheTest() {
+        for (const auto& fileName : configFiles) std::remove(fileName.c_str());
+        std::remove(cacheFile.c_str());
+    }
+
+    static void writeConfig(const std::string& fileName, double focalLength, double baseline) {
+        std::ofstream file(fileName);
+        file << "K:\n  rows: 3\n  cols: 3\n  data: [" << focalLength << ", 0, 32, 0, " << focalLength << ", 24, 0, 0, 1]\n";
+        file << "pose:\n  rows: 4\n  cols: 4\n  data: [1, 0, 0, " << baseline << ", 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1]\n";
+        file << "distortionParams: [0.1, -0.05, 0.001, 0.002]\n";
+    }
+
+    static void expectSameCameras(const std::vector<GIFT::CachedCamera>& a, const std::vector<GIFT::CachedCamera>& b) {
+        ASSERT_EQ(a.size(), b.size());
+        for (size_t i = 0; i < a.size(); ++i) {
+            EXPECT_EQ(cv::norm(a[i].camera.K, b[i].camera.K, cv::NORM_INF), 0);
+            EXPECT_EQ(a[i].camera.pose, b[i].camera.pose);
+            EXPECT_EQ(a[i].camera.P, b[i].camera.P);
+            EXPECT_EQ(a[i].camera.distortionParams, b[i].camera.distortionParams);
+            EXPECT_EQ(a[i].imageSize, b[i].imageSize);
+            EXPECT_EQ(cv::norm(a[i].undistortMapX, b[i].undistortMapX, cv::NORM_INF), 0);
+            EXPECT_EQ(cv::norm(a[i].undistortMapY, b[i].undistortMapY, cv::NORM_INF), 0);
+        }
+    }
+
+    const cv::Size imageSize = cv::Size(64, 48);
+    std::vector<std::string> configFiles;
+    std::string cacheFile;
+};
+
+TEST_F(RigCacheTest, MissThenHitGiveTheSameRig) {
+    std::vector<GIFT::CachedCamera> parsed;
+    {
+        GIFT::RigCache miss(configFiles, cacheFile, imageSize);
+        EXPECT_FALSE(miss.loadedFromCache());
+        parsed = miss.cameras();
+        for (auto& cached : parsed) {
+            cached.undistortMapX = cached.undistortMapX.clone();
+            cached.undistortMapY = cached.undistortMapY.clone();
+        }
+    }
+
+    // Copies of the cached cameras keep the mapping alive after the cache is gone.
+    std::vector<GIFT::CachedCamera> loaded;
+    {
+        GIFT::RigCache hit(configFiles, cacheFile, imageSize);
+        EXPECT_TRUE(hit.loadedFromCache());
+        loaded = hit.cameras();
+    }
+    expectSameCameras(loaded, parsed);
+    EXPECT_NEAR(loaded[0].camera.K.at<double>(0,0), 400, 1e-12);
+}
+
+TEST_F(RigCacheTest, ChangedConfigurationFallsBackToYaml) {
+    { GIFT::RigCache first(configFiles, cacheFile, imageSize); }
+
+    writeConfig(configFiles[1], 420, 0.1);
+    GIFT::RigCache stale(configFiles, cacheFile, imageSize);
+    EXPECT_FALSE(stale.loadedFromCache());
+    EXPECT_NEAR(stale.cameras()[1].camera.K.at<double>(0,0), 420, 1e-12);
+
+    // A different image size also needs new maps.
+    GIFT::RigCache resized(configFiles, cacheFile, cv::Size(32, 24));
+    EXPECT_FALSE(resized.loadedFromCache());
+    EXPECT_EQ(resized.cameras()[0].undistortMapX.size(), cv::Size(32, 24));
+
+    GIFT::RigCache rewritten(configFiles, cacheFile, cv::Size(32, 24));
+    EXPECT_TRUE(rewritten.loadedFromCache());
+}
+
+TEST_F(RigCacheTest, VersionMismatchFallsBackToYaml) {
+    { GIFT::RigCache first(configFiles, cacheFile, imageSize); }
+
+    // The version follows the eight byte magic.
+    std::fstream file(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+    const uint32_t otherVersion = 9999;
+    file.seekp(8);
+    file.write(reinterpret_cast<const char*>(&otherVersion), sizeof(otherVersion));
+    file.close();
+
+    GIFT::RigCache mismatch(configFiles, cacheFile, imageSize);
+    EXPECT_FALSE(mismatch.loadedFromCache());
+    EXPECT_NEAR(mismatch.cameras()[0].camera.K.at<double>(0,0), 400, 1e-12);
+
+    GIFT::RigCache rewritten(configFiles, cacheFile, imageSize);
+    EXPECT_TRUE(rewritten.loadedFromCache());
+}
@@ -0,0 +1,146 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "SharedLandmarkTransport.h"
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace GIFT;
+
+// Every frame has contents derived from its frame number, so readers can detect torn frames.
+static constexpr int frameKinds = 50;
+
+static std::vector<Landmark> landmarksOfFrame(int frameNumber) {
+    const int kind = frameNumber % frameKinds;
+    std::vector<Landmark> landmarks(kind + 1);
+    for (int i = 0; i < (int)landmarks.size(); ++i) {
+        landmarks[i].idNumber = 1000*kind + i;
+        landmarks[i].lifetime = kind;
+        landmarks[i].sphereCoordinates = Eigen::Vector3d(kind, i, 1);
+        landmarks[i].opticalFlowSphere = Eigen::Vector3d(-kind, -i, 2);
+    }
+    return landmarks;
+}
+
+static bool frameIsConsistent(const SharedLandmarkFrame& frame) {
+    const int kind = frame.frameNumber % frameKinds;
+    if ((int)frame.count != kind + 1) return false;
+    for (uint32_t i = 0; i < frame.count; ++i) {
+        const bool consistent = frame.ids[i] == 1000*kind + (int)i
+            && frame.lifetimes[i] == kind
+            && frame.bearings[3*i] == kind && frame.bearings[3*i+1] == i && frame.bearings[3*i+2] == 1
+            && frame.flows[3*i] == -kind && frame.flows[3*i+1] == -(float)i && frame.flows[3*i+2] == 2;
+        if (!consistent) return false;
+    }
+    return true;
+}
+
+static std::string transportName(const char* test) {
+    return "/gift_test_" + std::string(test) + "_" + std::to_string(getpid());
+}
+
+TEST(SharedLandmarkTransportTest, FramesAreReadInPlaceUntilOverwritten) {
+    const std::string name = transportName("inplace");
+    SharedLandmarkPublisher publisher(name, 100, 3);
+    SharedLandmarkReader reader(name);
+
+    SharedLandmarkFrame frame;
+    EXPECT_FALSE(reader.latest(frame));
+    std::vector<Landmark> copied;
+    EXPECT_EQ(reader.copyLatest(copied), SharedCopyStatus::Empty);
+
+    publisher.publish(7, landmarksOfFrame(7));
+    ASSERT_TRUE(reader.latest(frame));
+    EXPECT_EQ(frame.sequence, 1u);
+    EXPECT_EQ(frame.frameNumber, 7);
+    EXPECT_TRUE(frameIsConsistent(frame));
+    EXPECT_TRUE(reader.stillValid(frame));
+
+    // The frame survives until its slot comes round again.
+    publisher.publish(8, landmarksOfFrame(8));
+    publisher.publish(9, landmarksOfFrame(9));
+    EXPECT_TRUE(reader.stillValid(frame));
+    publisher.publish(10, landmarksOfFrame(10));
+    EXPECT_FALSE(reader.stillValid(frame));
+    EXPECT_FALSE(reader.frame(1, frame));
+    ASSERT_TRUE(reader.frame(2, frame));
+    EXPECT_EQ(frame.frameNumber, 8);
+
+    int frameNumber = 0;
+    uint64_t sequence = 0;
+    EXPECT_EQ(reader.copyLatest(copied, &frameNumber, &sequence), SharedCopyStatus::Copied);
+    EXPECT_EQ(sequence, 4u);
+    EXPECT_EQ(frameNumber, 10);
+    ASSERT_EQ(copied.size(), landmarksOfFrame(10).size());
+    EXPECT_EQ(copied.back().idNumber, 10000 + (int)copied.size() - 1);
+}
+
+TEST(SharedLandmarkTransportTest, ReaderProcessNeverSeesTornFrames) {
+    const std::string name = transportName("processes");
+    constexpr int frameCount = 200000;
+    // Two slots, so that the publisher regularly overwrites the frame the reader is on.
+    SharedLandmarkPublisher publisher(name, 64, 2);
+    std::vector<std::vector<Landmark>> frames;
+    for (int i = 0; i < frameKinds; ++i) frames.emplace_back(landmarksOfFrame(i));
+
+    // The reader tells the publisher when it has mapped the transport, so that they overlap.
+    int readyPipe[2];
+    ASSERT_EQ(pipe(readyPipe), 0);
+
+    const pid_t child = fork();
+    ASSERT_GE(child, 0);
+    if (child == 0) {
+        // Reader process: follow the frames until the last one, checking every frame that validates.
+        int exitCode = 0;
+        try {
+            SharedLandmarkReader reader(name);
+            const char ready = 1;
+            if (write(readyPipe[1], &ready, 1) != 1) _exit(4);
+            SharedLandmarkFrame frame;
+            int lastFrameNumber = -1;
+            int framesRead = 0;
+            while (lastFrameNumber < frameCount - 1) {
+                if (!reader.latest(frame) || frame.frameNumber == lastFrameNumber) continue;
+                const bool consistent = frameIsConsistent(frame);
+                if (!reader.stillValid(frame)) continue;
+                if (!consistent) {
+                    exitCode = 1;
+                    break;
+                }
+                lastFrameNumber = frame.frameNumber;
+                ++framesRead;
+            }
+            if (exitCode == 0 && framesRead == 0) exitCode = 2;
+        } catch (...) {
+            exitCode = 3;
+        }
+        _exit(exitCode);
+    }
+
+    char ready = 0;
+    ASSERT_EQ(read(readyPipe[0], &ready, 1), 1);
+    close(readyPipe[0]);
+    close(readyPipe[1]);
+    for (int i = 0; i < frameCount; ++i) publisher.publish(i, frames[i % frameKinds]);
+
+    int status = 0;
+    ASSERT_EQ(waitpid(child, &status, 0), child);
+    ASSERT_TRUE(WIFEXITED(status));
+    EXPECT_EQ(WEXITSTATUS(status), 0);
+}
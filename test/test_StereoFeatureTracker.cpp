@@ -0,0 +1,142 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "StereoFeatureTracker.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+class StereoFeatureTrackerTest : public ::testing::Test {
+protected:
+    StereoFeatureTrackerTest() {
+        // A rectified pair looking at a fronto-parallel textured plane. The view slides one pixel per frame
+        // and the plane slowly comes closer, so the disparity grows by a fraction of a pixel per frame.
+        cv::Mat texture(300, 460, CV_8UC3);
+        cv::randu(texture, cv::Scalar::all(0), cv::Scalar::all(255));
+        cv::GaussianBlur(texture, texture, cv::Size(7,7), 2.0);
+
+        for (int i = 0; i < frameCount; ++i) {
+            framesLeft.emplace_back(view(texture, i, i/2));
+            framesRight.emplace_back(view(texture, i + disparity(i), i/2));
+        }
+    }
+
+    // The 320x240 image whose pixel (x,y) shows the texture at (x + offsetX, y + offsetY)
+    static cv::Mat view(const cv::Mat& texture, double offsetX, double offsetY) {
+        cv::Mat shift = cv::Mat::eye(2, 3, CV_64F);
+        shift.at<double>(0,2) = -offsetX;
+        shift.at<double>(1,2) = -offsetY;
+        cv::Mat image;
+        cv::warpAffine(texture, image, shift, cv::Size(320, 240), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
+        return image;
+    }
+
+    static double disparity(int frame) { return 20.0 + 0.3*frame; }
+
+    static constexpr int frameCount = 20;
+    std::vector<cv::Mat> framesLeft;
+    std::vector<cv::Mat> framesRight;
+};
+
+TEST_F(StereoFeatureTrackerTest, TemporalModeFollowsTheDisparity) {
+    const GIFT::CameraParameters camera;
+    GIFT::StereoFeatureTracker tracker(camera, camera);
+    tracker.stereoMode = GIFT::StereoMode::Temporal;
+
+    std::map<int, GIFT::StereoLandmark> previousPairs;
+    int laterNewPairs = 0;
+    for (int i = 0; i < frameCount; ++i) {
+        tracker.processImages(framesLeft[i], framesRight[i]);
+        const std::shared_ptr<const GIFT::StereoLandmarkSnapshot> snapshot = tracker.latestSnapshot();
+        ASSERT_TRUE(snapshot);
+        EXPECT_EQ(snapshot->frameNumber, i + 1);
+        // Most of the left landmarks are paired. Only those near the left edge have no match in the right image.
+        EXPECT_GT(snapshot->stereoLandmarks.size(), snapshot->landmarksLeft().size() / 2);
+
+        std::map<int, GIFT::StereoLandmark> pairs;
+        int continuedPairs = 0;
+        for (const GIFT::StereoLandmark& pair : snapshot->stereoLandmarks) {
+            const GIFT::Landmark& left = snapshot->landmarkLeft(pair);
+            const GIFT::Landmark& right = snapshot->landmarkRight(pair);
+            EXPECT_EQ(left.idNumber, pair.idLeft);
+            EXPECT_EQ(right.idNumber, pair.idRight);
+            EXPECT_NEAR(left.camCoordinates.x - right.camCoordinates.x, disparity(i), 0.1);
+            EXPECT_FLOAT_EQ(left.camCoordinates.y, right.camCoordinates.y);
+
+            const auto previous = previousPairs.find(pair.idNumberStereo);
+            if (previous == previousPairs.end()) {
+                EXPECT_EQ(pair.lifetime, 0);
+                EXPECT_EQ(right.lifetime, 1);
+                if (i > 0) ++laterNewPairs;
+            } else {
+                EXPECT_EQ(pair.idLeft, previous->second.idLeft);
+                EXPECT_EQ(pair.idRight, previous->second.idRight);
+                EXPECT_EQ(pair.lifetime, previous->second.lifetime + 1);
+                EXPECT_EQ(right.lifetime, pair.lifetime + 1);
+                ++continuedPairs;
+            }
+            pairs.emplace(pair.idNumberStereo, pair);
+        }
+        // The pairs are followed from frame to frame rather than matched again.
+        if (i > 0) {
+            EXPECT_GT(continuedPairs, (int)previousPairs.size() / 2);
+        }
+        previousPairs.swap(pairs);
+    }
+
+    // Points detected as the view slides are matched too.
+    EXPECT_GT(laterNewPairs, 0);
+}
+
+TEST_F(StereoFeatureTrackerTest, FailedMatchesAreRetriedLater) {
+    // Points near the left edge have no match in the right image, and keep failing until they leave the view.
+    const GIFT::CameraParameters camera;
+    GIFT::StereoFeatureTracker everyFrame(camera, camera);
+    everyFrame.stereoMode = GIFT::StereoMode::Temporal;
+    everyFrame.matchRetryInterval = 1;
+    GIFT::StereoFeatureTracker tracker(camera, camera);
+    tracker.stereoMode = GIFT::StereoMode::Temporal;
+    tracker.matchRetryInterval = 5;
+
+    int fullMatchesEveryFrame = 0;
+    int fullMatches = 0;
+    int deferredMatches = 0;
+    for (int i = 0; i < frameCount; ++i) {
+        everyFrame.processImages(framesLeft[i], framesRight[i]);
+        tracker.processImages(framesLeft[i], framesRight[i]);
+        EXPECT_EQ(everyFrame.deferredMatches(), 0);
+        fullMatchesEveryFrame += everyFrame.fullMatches();
+        fullMatches += tracker.fullMatches();
+        deferredMatches += tracker.deferredMatches();
+
+        // Every left landmark is paired, matched in full or deferred.
+        const std::shared_ptr<const GIFT::StereoLandmarkSnapshot> snapshot = tracker.latestSnapshot();
+        const int continuedPairs = std::count_if(snapshot->stereoLandmarks.begin(), snapshot->stereoLandmarks.end(),
+                                                 [](const GIFT::StereoLandmark& pair) { return pair.lifetime > 0; });
+        EXPECT_EQ(continuedPairs + tracker.fullMatches() + tracker.deferredMatches(),
+                  (int)snapshot->landmarksLeft().size());
+
+        // Deferring the failed matches loses almost no pairs.
+        EXPECT_GE(snapshot->stereoLandmarks.size(), 0.9*everyFrame.latestSnapshot()->stereoLandmarks.size());
+    }
+
+    EXPECT_GT(deferredMatches, 0);
+    EXPECT_LT(fullMatches, fullMatchesEveryFrame);
+}
@@ -0,0 +1,114 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "TrackLog.h"
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <unistd.h>
+
+class TrackLogTest : public ::testing::Test {
+protected:
+    TrackLogTest() {
+        fileName = "test_TrackLog_" + std::to_string(getpid()) + ".gtl";
+        for (int frame = 0; frame < frameCount; ++frame) {
+            std::vector<GIFT::Landmark> landmarks;
+            for (int i = 0; i < 5 + frame; ++i) {
+                GIFT::Landmark lm;
+                lm.camCoordinates = cv::Point2f(i + 0.25f, frame + 0.5f);
+                lm.camCoordinatesNorm = cv::Point2f(0.01f*i, -0.01f*frame);
+                lm.opticalFlowSphere = Eigen::Vector3d(i, -frame, 0.5);
+                lm.idNumber = 100*frame + i;
+                lm.lifetime = frame + 1;
+                landmarks.emplace_back(lm);
+            }
+            frames.emplace_back(landmarks);
+        }
+    }
+    ~TrackLogTest() { std::remove(fileName.c_str()); }
+
+    void writeLog() {
+        GIFT::TrackLogWriter writer(fileName, 2);
+        for (const auto& landmarks : frames) writer.writeFrame(landmarks);
+        writer.flush();
+        EXPECT_EQ(writer.framesWritten(), (uint64_t)frameCount);
+        EXPECT_TRUE(writer.writeError().empty());
+    }
+
+    static constexpr int frameCount = 20;
+    std::string fileName;
+    std::vector<std::vector<GIFT::Landmark>> frames;
+};
+
+TEST_F(TrackLogTest, WrittenFramesReadBack) {
+    writeLog();
+
+    GIFT::TrackLogReader reader(fileName);
+    ASSERT_EQ(reader.frameCount(), (size_t)frameCount);
+    for (int f = 0; f < frameCount; ++f) {
+        const GIFT::TrackLogFrame frame = reader.frame(f);
+        EXPECT_EQ(frame.frameIndex, (uint64_t)f);
+        ASSERT_EQ(frame.count, frames[f].size());
+        for (uint32_t i = 0; i < frame.count; ++i) {
+            const GIFT::Landmark& lm = frames[f][i];
+            EXPECT_EQ(frame.ids[i], lm.idNumber);
+            EXPECT_EQ(frame.lifetimes[i], lm.lifetime);
+            EXPECT_EQ(frame.camCoordinates[2*i], lm.camCoordinates.x);
+            EXPECT_EQ(frame.camCoordinates[2*i+1], lm.camCoordinates.y);
+            EXPECT_EQ(frame.camCoordinatesNorm[2*i], lm.camCoordinatesNorm.x);
+            EXPECT_EQ(frame.camCoordinatesNorm[2*i+1], lm.camCoordinatesNorm.y);
+            for (int k = 0; k < 3; ++k) EXPECT_EQ(frame.opticalFlowSphere[3*i+k], (float)lm.opticalFlowSphere(k));
+        }
+    }
+}
+
+TEST_F(TrackLogTest, PartialFinalFrameIsIgnored) {
+    writeLog();
+    std::ifstream in(fileName, std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+    std::ofstream(fileName, std::ios::binary | std::ios::trunc).write(contents.data(), contents.size() - 10);
+
+    GIFT::TrackLogReader reader(fileName);
+    EXPECT_EQ(reader.frameCount(), (size_t)frameCount - 1);
+}
+
+TEST_F(TrackLogTest, CorruptFrameHeaderIsRejected) {
+    writeLog();
+    std::fstream file(fileName, std::ios::binary | std::ios::in | std::ios::out);
+    // Claim more landmarks in the first frame than its block holds.
+    const uint32_t count = 1000;
+    file.seekp(sizeof(GIFT::TrackLogFileHeader) + offsetof(GIFT::TrackLogFrameHeader, count));
+    file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    file.close();
+
+    EXPECT_THROW(GIFT::TrackLogReader reader(fileName), std::runtime_error);
+}
+
+#ifdef __linux__
+TEST_F(TrackLogTest, WriteFailureIsReported) {
+    // Every write to /dev/full fails with ENOSPC.
+    GIFT::TrackLogWriter writer("/dev/full", 2);
+    writer.writeFrame(frames[0]);
+    EXPECT_THROW(writer.flush(), std::runtime_error);
+    EXPECT_FALSE(writer.writeError().empty());
+    EXPECT_THROW(writer.writeFrame(frames[1]), std::runtime_error);
+}
+#endif
@@ -0,0 +1,154 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "TrackingBudget.h"
+
+class TrackingBudgetTest : public ::testing::Test {
+protected:
+    // Frame times adding up to the given fraction of the target latency
+    GIFT::StageTimes frameTimes(double fraction, double trackingShare = 0.7) const {
+        GIFT::StageTimes times;
+        times.total = fraction * targetLatency;
+        times.tracking = trackingShare * times.total;
+        times.detection = times.total - times.tracking;
+        return times;
+    }
+
+    // Feeds the same frame times until the budget changes the effort, and returns the number of frames it took.
+    static int framesUntilChange(GIFT::TrackingBudget& budget, const GIFT::StageTimes& times, int maxFrames = 100) {
+        for (int frame = 1; frame <= maxFrames; ++frame) {
+            if (budget.update(times).action != GIFT::BudgetAction::Hold) return frame;
+        }
+        return -1;
+    }
+
+    const double targetLatency = 0.02;
+    const GIFT::TrackingEffort fullTracking = {500, 3, cv::Size(21,21)};
+    const GIFT::DetectionEffort fullDetection = {1.0, 1.0};
+};
+
+TEST_F(TrackingBudgetTest, ReducesTheCostlierStageNearTheTarget) {
+    GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+
+    // Within the target, but above the reduce fraction. Tracking costs more, so it is cut first, once the
+    // settle frames have passed.
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.95)), budget.reduceSettleFrames);
+    EXPECT_EQ(budget.lastDecision().action, GIFT::BudgetAction::ReduceTracking);
+    EXPECT_EQ(budget.lastDecision().trackingLevel, 1);
+    EXPECT_EQ(budget.lastDecision().detectionLevel, 0);
+    EXPECT_EQ(budget.trackingEffort().window.width, budget.trackingLadder[1].window.width);
+
+    // When detection costs more, it is cut instead.
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.95, 0.3)), budget.reduceSettleFrames);
+    EXPECT_EQ(budget.lastDecision().action, GIFT::BudgetAction::ReduceDetection);
+    EXPECT_EQ(budget.lastDecision().trackingLevel, 1);
+    EXPECT_EQ(budget.lastDecision().detectionLevel, 1);
+    EXPECT_DOUBLE_EQ(budget.lastDecision().estimatedFrameTime, 0.95*targetLatency);
+}
+
+TEST_F(TrackingBudgetTest, HoldsBetweenTheFractions) {
+    GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+    ASSERT_LT(budget.increaseFraction, 0.75);
+    ASSERT_GT(budget.reduceFraction, 0.75);
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.75)), -1);
+    EXPECT_EQ(budget.lastDecision().trackingLevel, 0);
+    EXPECT_EQ(budget.lastDecision().detectionLevel, 0);
+}
+
+TEST_F(TrackingBudgetTest, PlansForTheSlowestRecentFrame) {
+    GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+    budget.update(frameTimes(0.95));
+    // Fast frames do not hide a slow one that is still among the recent frames.
+    EXPECT_EQ(budget.update(frameTimes(0.3)).action, GIFT::BudgetAction::ReduceTracking);
+    EXPECT_DOUBLE_EQ(budget.lastDecision().estimatedFrameTime, 0.95*targetLatency);
+}
+
+TEST_F(TrackingBudgetTest, IncreasesSlowlyWithHeadroom) {
+    GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+    framesUntilChange(budget, frameTimes(0.95));
+    framesUntilChange(budget, frameTimes(0.95, 0.3));
+    ASSERT_EQ(budget.lastDecision().trackingLevel, 1);
+    ASSERT_EQ(budget.lastDecision().detectionLevel, 1);
+
+    // Effort comes back only after the settle frames, and with a full window of recent frames.
+    ASSERT_GE(budget.increaseSettleFrames, budget.recentFrames);
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.3)), budget.increaseSettleFrames);
+    EXPECT_EQ(budget.lastDecision().action, GIFT::BudgetAction::IncreaseTracking);
+    EXPECT_EQ(budget.lastDecision().trackingLevel, 0);
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.3)), budget.increaseSettleFrames);
+    EXPECT_EQ(budget.lastDecision().action, GIFT::BudgetAction::IncreaseDetection);
+    EXPECT_EQ(budget.lastDecision().detectionLevel, 0);
+
+    // At full effort there is nothing more to restore.
+    EXPECT_EQ(framesUntilChange(budget, frameTimes(0.3)), -1);
+}
+
+TEST_F(TrackingBudgetTest, StopsAtTheEndsOfTheLadders) {
+    GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+    const int cheapestTracking = budget.trackingLadder.size() - 1;
+    const int cheapestDetection = budget.detectionLadder.size() - 1;
+
+    // Over the target, every stage is cut as far as it goes, and then the effort holds.
+    int changes = 0;
+    while (framesUntilChange(budget, frameTimes(2.0)) > 0) ++changes;
+    EXPECT_EQ(changes, cheapestTracking + cheapestDetection);
+    EXPECT_EQ(budget.lastDecision().trackingLevel, cheapestTracking);
+    EXPECT_EQ(budget.lastDecision().detectionLevel, cheapestDetection);
+    EXPECT_EQ(budget.lastDecision().action, GIFT::BudgetAction::Hold);
+}
+
+TEST_F(TrackingBudgetTest, LaddersNeverExceedTheFullEffort) {
+    // Small and non-square windows keep their shape, and shrink along each side on its own.
+    for (const cv::Size& window : {cv::Size(7,7), cv::Size(21,21), cv::Size(31,11), cv::Size(9,25)}) {
+        const GIFT::TrackingEffort full = {200, 4, window};
+        const GIFT::TrackingBudget budget(targetLatency, full, fullDetection);
+        ASSERT_EQ(budget.trackingLadder.front().window.width, window.width);
+        ASSERT_EQ(budget.trackingLadder.front().window.height, window.height);
+        for (size_t level = 1; level < budget.trackingLadder.size(); ++level) {
+            const GIFT::TrackingEffort& effort = budget.trackingLadder[level];
+            const GIFT::TrackingEffort& above = budget.trackingLadder[level - 1];
+            EXPECT_LE(effort.window.width, above.window.width);
+            EXPECT_LE(effort.window.height, above.window.height);
+            EXPECT_GE(effort.window.width, std::min(window.width, 9));
+            EXPECT_GE(effort.window.height, std::min(window.height, 9));
+            EXPECT_EQ(effort.window.width % 2, 1);
+            EXPECT_EQ(effort.window.height % 2, 1);
+            EXPECT_LE(effort.pyramidLevels, above.pyramidLevels);
+            EXPECT_GE(effort.pyramidLevels, 1);
+            EXPECT_LE(effort.maxFeatures, above.maxFeatures);
+            EXPECT_GE(effort.maxFeatures, 1);
+        }
+        if (window.width > window.height) {
+            EXPECT_GT(budget.trackingLadder.back().window.width, budget.trackingLadder.back().window.height);
+        }
+    }
+
+    const GIFT::TrackingBudget budget(targetLatency, fullTracking, fullDetection);
+    for (size_t level = 1; level < budget.detectionLadder.size(); ++level) {
+        const GIFT::DetectionEffort& effort = budget.detectionLadder[level];
+        const GIFT::DetectionEffort& above = budget.detectionLadder[level - 1];
+        EXPECT_LE(effort.featureSearchThreshold, above.featureSearchThreshold);
+        EXPECT_LE(effort.coverage, above.coverage);
+        EXPECT_GT(effort.coverage, 0);
+    }
+}
+
+TEST_F(TrackingBudgetTest, RejectsNonPositiveTargets) {
+    EXPECT_THROW(GIFT::TrackingBudget(0, fullTracking, fullDetection), std::invalid_argument);
+    EXPECT_THROW(GIFT::TrackingBudget(-1, fullTracking, fullDetection), std::invalid_argument);
+}
@@ -0,0 +1,264 @@
+/* 
+    This file is part of GIFT.
+
+    GIFT is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    GIFT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with GIFT.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "gtest/gtest.h"
+#include "TrackingService.h"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "SlidingTexture.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <future>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Holds pool threads in the result callback until the test releases them.
+class CallbackGate {
+public:
+    void enter() {
+        std::unique_lock<std::mutex> lock(mutex);
+        ++entered;
+        changed.notify_all();
+        changed.wait(lock, [this]() { return released; });
+    };
+    void waitForEntries(int count) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this, count]() { return entered >= count; });
+    };
+    void release() {
+        std::lock_guard<std::mutex> lock(mutex);
+        released = true;
+        changed.notify_all();
+    };
+
+protected:
+    std::mutex mutex;
+    std::condition_variable changed;
+    int entered = 0;
+    bool released = false;
+};
+
+class TrackingServiceTest : public ::testing::Test {
+protected:
+    TrackingServiceTest() {
+        tracker.maxFeatures = 100;
+    }
+
+    // Records the delivered results of every stream, in delivery order.
+    GIFT::TrackingService::ResultCallback recordResults() {
+        return [this](const GIFT::StreamResult& result) {
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            results[result.streamId].emplace_back(result);
+        };
+    }
+
+    std::vector<long> deliveredFrames(int streamId) {
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        std::vector<long> indices;
+        for (const auto& result : results[streamId]) indices.emplace_back(result.frameIndex);
+        return indices;
+    }
+
+    static constexpr int frameCount = 20;
+    std::vector<cv::Mat> frames = slidingTextureFrames(frameCount);
+    GIFT::FeatureTracker tracker;
+
+    std::mutex resultsMutex;
+    std::map<int, std::vector<GIFT::StreamResult>> results;
+};
+
+TEST_F(TrackingServiceTest, FramesAreDeliveredInOrderPerStream) {
+    GIFT::TrackingService service(recordResults(), 2);
+    const int streamCount = 3;
+    for (int i = 0; i < streamCount; ++i) service.addStream(tracker);
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        for (int stream = 0; stream < streamCount; ++stream) service.submitFrame(stream, frames[frame]);
+    }
+    service.waitIdle();
+
+    for (int stream = 0; stream < streamCount; ++stream) {
+        ASSERT_EQ(results[stream].size(), (size_t)frameCount);
+        for (int frame = 0; frame < frameCount; ++frame) {
+            const GIFT::StreamResult& result = results[stream][frame];
+            EXPECT_EQ(result.streamId, stream);
+            EXPECT_EQ(result.frameIndex, frame);
+            EXPECT_TRUE(result.error.empty()) << result.error;
+            ASSERT_TRUE(result.landmarks);
+            EXPECT_EQ(result.landmarks->frameNumber, frame + 1);
+        }
+        EXPECT_EQ(service.pendingFrames(stream), 0u);
+        EXPECT_EQ(service.droppedFrames(stream), 0u);
+    }
+}
+
+TEST_F(TrackingServiceTest, BlockingSubmitWaitsForRoom) {
+    CallbackGate gate;
+    GIFT::TrackingService service([&gate, record = recordResults()](const GIFT::StreamResult& result) {
+        if (result.frameIndex == 0) gate.enter();
+        record(result);
+    }, 1);
+    GIFT::StreamOptions options;
+    options.maxPendingFrames = 2;
+    options.dropPolicy = GIFT::FrameDropPolicy::Block;
+    options.computeEgoMotion = false;
+    const int stream = service.addStream(tracker, options);
+
+    // The only worker is held delivering frame 0, so frame 1 waits and frame 2 has no room.
+    EXPECT_TRUE(service.submitFrame(stream, frames[0]));
+    gate.waitForEntries(1);
+    EXPECT_TRUE(service.submitFrame(stream, frames[1]));
+    std::future<bool> blockedSubmit = std::async(std::launch::async, [&]() { return service.submitFrame(stream, frames[2]); });
+    EXPECT_EQ(blockedSubmit.wait_for(std::chrono::milliseconds(200)), std::future_status::timeout);
+    EXPECT_EQ(service.pendingFrames(stream), 2u);
+
+    gate.release();
+    EXPECT_TRUE(blockedSubmit.get());
+    service.waitIdle();
+    EXPECT_EQ(deliveredFrames(stream), std::vector<long>({0, 1, 2}));
+    EXPECT_EQ(service.droppedFrames(stream), 0u);
+}
+
+TEST_F(TrackingServiceTest, DropOldestDiscardsWaitingFrames) {
+    CallbackGate gate;
+    GIFT::TrackingService service([&gate, record = recordResults()](const GIFT::StreamResult& result) {
+        if (result.frameIndex == 0) gate.enter();
+        record(result);
+    }, 1);
+    GIFT::StreamOptions options;
+    options.maxPendingFrames = 2;
+    options.dropPolicy = GIFT::FrameDropPolicy::DropOldest;
+    options.computeEgoMotion = false;
+    const int stream = service.addStream(tracker, options);
+
+    // Frame 0 is being delivered and cannot be dropped. Each new frame replaces the one waiting behind it.
+    EXPECT_TRUE(service.submitFrame(stream, frames[0]));
+    gate.waitForEntries(1);
+    EXPECT_TRUE(service.submitFrame(stream, frames[1]));
+    EXPECT_FALSE(service.submitFrame(stream, frames[2]));
+    EXPECT_FALSE(service.submitFrame(stream, frames[3]));
+    EXPECT_FALSE(service.trySubmitFrame(stream, frames[4]));
+    EXPECT_EQ(service.droppedFrames(stream), 2u);
+
+    gate.release();
+    service.waitIdle();
+    EXPECT_EQ(deliveredFrames(stream), std::vector<long>({0, 3}));
+    EXPECT_EQ(service.pendingFrames(stream), 0u);
+}
+
+TEST_F(TrackingServiceTest, WaitIdleWaitsForEveryFrame) {
+    std::atomic<int> delivered{0};
+    GIFT::TrackingService service([&](const GIFT::StreamResult&) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        ++delivered;
+    }, 2);
+    const int streamA = service.addStream(tracker);
+    const int streamB = service.addStream(tracker);
+
+    for (int frame = 0; frame < frameCount; ++frame) {
+        service.submitFrame(streamA, frames[frame]);
+        service.submitFrame(streamB, frames[frame]);
+    }
+    service.waitIdle();
+    EXPECT_EQ(delivered, 2*frameCount);
+    EXPECT_EQ(service.pendingFrames(streamA), 0u);
+    EXPECT_EQ(service.pendingFrames(streamB), 0u);
+}
+
+TEST_F(TrackingServiceTest, CallbackCannotWaitForRoom) {
+    // With one worker and one pending frame, waiting for room inside the callback would never return.
+    bool submitThrew = false;
+    bool trySubmitQueued = true;
+    bool waitIdleThrew = false;
+    GIFT::TrackingService* servicePointer = nullptr;
+    int stream = -1;
+    GIFT::TrackingService service([&](const GIFT::StreamResult& result) {
+        if (result.frameIndex != 0) return;
+        try {
+            servicePointer->submitFrame(stream, frames[1]);
+        } catch (const std::logic_error&) {
+            submitThrew = true;
+        }
+        trySubmitQueued = servicePointer->trySubmitFrame(stream, frames[1]);
+        try {
+            servicePointer->waitIdle();
+        } catch (const std::logic_error&) {
+            waitIdleThrew = true;
+        }
+    }, 1);
+    servicePointer = &service;
+    GIFT::StreamOptions options;
+    options.maxPendingFrames = 1;
+    options.computeEgoMotion = false;
+    stream = service.addStream(tracker, options);
+
+    service.submitFrame(stream, frames[0]);
+    service.waitIdle();
+    EXPECT_TRUE(submitThrew);
+    EXPECT_FALSE(trySubmitQueued);
+    EXPECT_TRUE(waitIdleThrew);
+}
+
+TEST_F(TrackingServiceTest, StreamsDoNotShareTheTrackerTheyWereAddedWith) {
+    // A tracker that already has images, pyramids and a warm corner cache, detecting on every frame.
+    tracker.cornerDetector = std::make_shared<GIFT::CornerResponseCache>();
+    tracker.trackingBackend = GIFT::TrackingBackend::Builtin;
+    for (int frame = 0; frame < 2; ++frame) tracker.processImage(frames[frame]);
+    const int trackerFrames = tracker.latestSnapshot()->frameNumber;
+
+    // Each stream tracks other images. What it finds must match a copy of the tracker run on its own.
+    std::vector<cv::Mat> flippedFrames;
+    for (const cv::Mat& frame : frames) {
+        flippedFrames.emplace_back();
+        cv::flip(frame, flippedFrames.back(), 1);
+    }
+    std::vector<GIFT::Landmark> expectedA, expectedB;
+    {
+        GIFT::FeatureTracker copyA = tracker;
+        GIFT::FeatureTracker copyB = tracker;
+        for (int frame = 2; frame < frameCount; ++frame) {
+            copyA.processImage(frames[frame]);
+            copyB.processImage(flippedFrames[frame]);
+        }
+        expectedA = copyA.outputLandmarks();
+        expectedB = copyB.outputLandmarks();
+    }
+
+    GIFT::TrackingService service(recordResults(), 2);
+    GIFT::StreamOptions options;
+    options.computeEgoMotion = false;
+    const int streamA = service.addStream(tracker, options);
+    const int streamB = service.addStream(tracker, options);
+    for (int frame = 2; frame < frameCount; ++frame) {
+        service.submitFrame(streamA, frames[frame]);
+        service.submitFrame(streamB, flippedFrames[frame]);
+    }
+    service.waitIdle();
+
+    auto expectSameLandmarks = [](const std::vector<GIFT::Landmark>& actual, const std::vector<GIFT::Landmark>& expected) {
+        ASSERT_EQ(actual.size(), expected.size());
+        for (size_t i = 0; i < actual.size(); ++i) {
+            EXPECT_EQ(actual[i].idNumber, expected[i].idNumber);
+            EXPECT_EQ(actual[i].camCoordinates, expected[i].camCoordinates);
+        }
+    };
+    expectSameLandmarks(service.latestSnapshot(streamA)->landmarks, expectedA);
+    expectSameLandmarks(service.latestSnapshot(streamB)->landmarks, expectedB);
+    EXPECT_EQ(tracker.latestSnapshot()->frameNumber, trackerFrames);
+}